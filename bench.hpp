@@ -0,0 +1,8 @@
+#define SASS_BENCH_INCLUDED
+
+#include <ctime>
+
+// Shared by the bench_*.cpp programs.
+
+static double seconds_since(std::clock_t start)
+{ return static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC; }
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef SASS_NODE_INCLUDED
+#include "node.hpp"
+#endif
+
+#include "node_factory.hpp"
+
+#ifndef SASS_BENCH_INCLUDED
+#include "bench.hpp"
+#endif
+
+// Times Node::flatten on blocks made of more and more expansions, the way a
+// block full of @includes comes out of eval. Flattening should take time in
+// proportion to the number of statements, so the time per expansion should
+// stay flat as the block grows.
+
+using namespace Sass;
+using namespace std;
+
+const size_t rules_per_expansion = 3;
+
+int main()
+{
+  for (size_t expansions = 1000; expansions <= 64000; expansions *= 4) {
+    Node_Factory new_Node;
+    Node block(new_Node(Node::block, 0, 0, expansions));
+    for (size_t i = 0; i < expansions; ++i) {
+      Node expn(new_Node(Node::expansion, 0, 0, rules_per_expansion));
+      for (size_t j = 0; j < rules_per_expansion; ++j) {
+        expn << new_Node(Node::rule, 0, 0, 2);
+      }
+      block << new_Node(Node::rule, 0, 0, 2) << expn;
+    }
+
+    clock_t start = clock();
+    block.flatten();
+    double elapsed = seconds_since(start);
+
+    if (block.size() != expansions * (rules_per_expansion + 1)) {
+      cerr << "flattened block has " << block.size() << " statements" << endl;
+      return 1;
+    }
+    cout << expansions << " expansions: " << elapsed << "s ("
+         << elapsed / expansions * 1e9 << "ns each)" << endl;
+    new_Node.free();
+  }
+
+  return 0;
+}
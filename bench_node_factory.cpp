@@ -0,0 +1,65 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef SASS_NODE_INCLUDED
+#include "node.hpp"
+#endif
+
+#include "node_factory.hpp"
+
+#ifndef SASS_BENCH_INCLUDED
+#include "bench.hpp"
+#endif
+
+// Compares the throughput of the Node_Factory's chunked allocator against
+// the old scheme of a separate new/delete per Node_Impl. Both loops set up
+// the same fields and keep every node until the round is over.
+
+using namespace Sass;
+using namespace std;
+
+const size_t rounds = 20;
+const size_t nodes_per_round = 250000;
+
+int main()
+{
+  double checksum = 0;
+
+  clock_t start = clock();
+  for (size_t r = 0; r < rounds; ++r) {
+    vector<Node_Impl*> pool;
+    pool.reserve(nodes_per_round);
+    for (size_t i = 0; i < nodes_per_round; ++i) {
+      Node_Impl* ip = new Node_Impl();
+      ip->type = Node::number;
+      ip->file = 0;
+      ip->offset = 0;
+      ip->value.numeric = i;
+      pool.push_back(ip);
+    }
+    checksum += pool.back()->value.numeric;
+    for (size_t i = 0, S = pool.size(); i < S; ++i) delete pool[i];
+  }
+  double individual = seconds_since(start);
+
+  start = clock();
+  for (size_t r = 0; r < rounds; ++r) {
+    Node_Factory new_Node;
+    vector<Node> pool;
+    pool.reserve(nodes_per_round);
+    for (size_t i = 0; i < nodes_per_round; ++i) {
+      pool.push_back(new_Node(0, 0, i));
+    }
+    checksum += pool.back().numeric_value();
+    new_Node.free();
+  }
+  double chunked = seconds_since(start);
+
+  cout << rounds * nodes_per_round << " nodes allocated and released" << endl;
+  cout << "new/delete per node: " << individual << "s" << endl;
+  cout << "chunked factory:     " << chunked << "s" << endl;
+  cout << "(checksum " << checksum << ")" << endl;
+
+  return 0;
+}
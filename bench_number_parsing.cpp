@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#ifndef SASS_NODE_INCLUDED
+#include "node.hpp"
+#endif
+
+#ifndef SASS_BENCH_INCLUDED
+#include "bench.hpp"
+#endif
+
+// Compares reading numeric literals with Token::to_number, as the parser
+// now does once per literal, against the std::atof that eval used to call
+// every time a literal was evaluated.
+
+using namespace Sass;
+using namespace std;
+
+const size_t rounds = 200;
+
+int main()
+{
+  const char* samples[] = {
+    "0", "1", "12", "960", "16px", "1.5em", ".5", "-.25", "0.1", "1.005",
+    "33.333333333333333%", "-3.75px", "100%", "1.23456789rem", "2.5vw",
+    "123456789012345678.5", "12345678901234567890123"
+  };
+  const size_t n = sizeof(samples) / sizeof(samples[0]);
+
+  // a stylesheet's worth of literals
+  vector<Token> literals;
+  for (size_t i = 0; i < 10000; ++i) literals.push_back(Token::make(samples[i % n]));
+
+  for (size_t i = 0; i < n; ++i) {
+    Token t(Token::make(samples[i]));
+    if (t.to_number() != std::atof(samples[i])) {
+      cerr << samples[i] << " read as " << t.to_number() << ", expected " << std::atof(samples[i]) << endl;
+      return 1;
+    }
+  }
+
+  double checksum = 0;
+
+  clock_t start = clock();
+  for (size_t r = 0; r < rounds; ++r) {
+    for (size_t i = 0, S = literals.size(); i < S; ++i) checksum += std::atof(literals[i].begin);
+  }
+  double libc = seconds_since(start);
+
+  start = clock();
+  for (size_t r = 0; r < rounds; ++r) {
+    for (size_t i = 0, S = literals.size(); i < S; ++i) checksum += literals[i].to_number();
+  }
+  double token = seconds_since(start);
+
+  cout << rounds * literals.size() << " literals read" << endl;
+  cout << "std::atof:          " << libc << "s" << endl;
+  cout << "Token::to_number:   " << token << "s" << endl;
+  cout << "(checksum " << checksum << ")" << endl;
+
+  return 0;
+}
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <string>
+#include <cctype>
+
+#ifndef SASS_PRELEXER_INCLUDED
+#include "prelexer.hpp"
+#endif
+
+#ifndef SASS_BENCH_INCLUDED
+#include "bench.hpp"
+#endif
+
+// Compares the prelexer's table-driven character classes against the
+// <cctype> predicates they replaced, scanning a stylesheet's worth of text
+// into runs of spaces, words, digits and punctuation. Also checks that the
+// two agree on every byte. Then compares skipping whitespace and comments
+// and finding the ends of strings a byte at a time against the scanning
+// kernels.
+
+using namespace Sass;
+using namespace std;
+
+const size_t rounds = 200;
+
+// the old definitions
+const char* ctype_space(const char* src) { return std::isspace(*src) ? src+1 : 0; }
+const char* ctype_alpha(const char* src) { return std::isalpha(*src) ? src+1 : 0; }
+const char* ctype_digit(const char* src) { return std::isdigit(*src) ? src+1 : 0; }
+const char* ctype_xdigit(const char* src) { return std::isxdigit(*src) ? src+1 : 0; }
+const char* ctype_alnum(const char* src) { return std::isalnum(*src) ? src+1 : 0; }
+const char* ctype_punct(const char* src) { return std::ispunct(*src) ? src+1 : 0; }
+
+static const char* byte_skip_spaces(const char* src)
+{
+  while (ctype_space(src)) ++src;
+  return src;
+}
+
+static const char* byte_find_char(const char* src, char c)
+{
+  while (*src && *src != c) ++src;
+  return src;
+}
+
+// skips comments and whitespace, and steps over quoted strings
+template <const char* (*skip_spaces)(const char*), const char* (*find_char)(const char*, char)>
+static size_t skim(const char* src)
+{
+  size_t strings = 0;
+  while (*src) {
+    src = skip_spaces(src);
+    if (src[0] == '/' && src[1] == '*') {
+      for (src = find_char(src + 2, '*'); *src && src[1] != '/'; src = find_char(src + 1, '*')) ;
+      if (*src) src += 2;
+    }
+    else if (src[0] == '/' && src[1] == '/') src = find_char(src, '\n');
+    else if (*src == '"') {
+      src = find_char(src + 1, '"');
+      if (*src) ++src, ++strings;
+    }
+    else if (*src) ++src;
+  }
+  return strings;
+}
+
+template <Prelexer::prelexer space, Prelexer::prelexer alnum, Prelexer::prelexer punct>
+static size_t tokenize(const char* src)
+{
+  size_t tokens = 0;
+  while (*src) {
+    const char* p;
+    if      ((p = Prelexer::one_plus<space>(src))) src = p;
+    else if ((p = Prelexer::one_plus<alnum>(src))) src = p, ++tokens;
+    else if ((p = punct(src)))                     src = p, ++tokens;
+    else                                           ++src;
+  }
+  return tokens;
+}
+
+int main()
+{
+  for (int c = 1; c < 128; ++c) {
+    char s[2] = { static_cast<char>(c), 0 };
+    if (!Prelexer::space(s)  != !ctype_space(s)  || !Prelexer::alpha(s) != !ctype_alpha(s) ||
+        !Prelexer::digit(s)  != !ctype_digit(s)  || !Prelexer::xdigit(s) != !ctype_xdigit(s) ||
+        !Prelexer::alnum(s)  != !ctype_alnum(s)  || !Prelexer::punct(s) != !ctype_punct(s)) {
+      cerr << "classes differ for character " << c << endl;
+      return 1;
+    }
+  }
+
+  string text;
+  for (size_t i = 0; i < 2000; ++i) {
+    text += ".nav-item-12 > a:hover, #sidebar .widget h2 {\n"
+            "  margin: 0 auto 1.5em;\n"
+            "  color: darken($link-color, 10%);\n"
+            "  font: 12px/1.5 \"Helvetica Neue\", Arial, sans-serif; }\n";
+  }
+
+  size_t checksum = 0;
+
+  clock_t start = clock();
+  for (size_t r = 0; r < rounds; ++r) checksum += tokenize<ctype_space, ctype_alnum, ctype_punct>(text.c_str());
+  double ctype = seconds_since(start);
+
+  start = clock();
+  for (size_t r = 0; r < rounds; ++r) checksum += tokenize<Prelexer::space, Prelexer::alnum, Prelexer::punct>(text.c_str());
+  double table = seconds_since(start);
+
+  string partial;
+  for (size_t i = 0; i < 2000; ++i) {
+    partial += "/* ------------------------------------------------------------\n"
+               " * Buttons: the base class and its modifiers. Everything below\n"
+               " * is overridable through the settings partial.\n"
+               " * ------------------------------------------------------------ */\n"
+               "\n\n        // legacy aliases, kept for the 2.x themes; drop in 4.0\n"
+               "        $font-stack: \"Helvetica Neue\", \"Segoe UI\", Roboto, \"Noto Sans\";\n"
+               "        $icon: url(\"data:image/svg+xml;charset=utf8,%3Csvg xmlns='http://www.w3.org/2000/svg'%3E\");\n";
+  }
+
+  start = clock();
+  for (size_t r = 0; r < rounds; ++r) checksum += skim<byte_skip_spaces, byte_find_char>(partial.c_str());
+  double bytewise = seconds_since(start);
+
+  Prelexer::scan_text(partial.c_str(), partial.c_str() + partial.size());
+  start = clock();
+  for (size_t r = 0; r < rounds; ++r) checksum += skim<Prelexer::skip_spaces, Prelexer::find_char>(partial.c_str());
+  double kernels = seconds_since(start);
+
+  cout << rounds * text.size() << " bytes scanned" << endl;
+  cout << "<cctype> predicates: " << ctype << "s" << endl;
+  cout << "class table:         " << table << "s" << endl;
+  cout << rounds * partial.size() << " bytes of comments, whitespace and strings skimmed" << endl;
+  cout << "a byte at a time:    " << bytewise << "s" << endl;
+  cout << "scanning kernels:    " << kernels << "s" << endl;
+  cout << "(checksum " << checksum << ")" << endl;
+
+  return 0;
+}
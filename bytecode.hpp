@@ -0,0 +1,62 @@
+#define SASS_BYTECODE_INCLUDED
+
+#include <vector>
+
+#ifndef SASS_NODE_INCLUDED
+#include "node.hpp"
+#endif
+
+namespace Sass {
+  using std::vector;
+
+  // Arithmetic and logical expressions (disjunctions, conjunctions,
+  // relations, expressions and terms) are compiled into programs for a small
+  // register machine; see compile and execute in eval_apply.cpp. Numbers and
+  // dimensions stay unboxed in the registers. Operations on anything else
+  // are done the way eval would do them, on the values already in the
+  // registers, so each operand is only ever evaluated once.
+
+  struct Instruction {
+    enum Opcode {
+      load_number,       // dst <- the textual number in constants[k]
+      load_dimension,    // dst <- the textual dimension in constants[k]
+      load_variable,     // dst <- the value of the variable in constants[k]
+      evaluate,          // dst <- eval(constants[k])
+      arithmetic,        // dst <- lhs op rhs, positioned at constants[k]
+      compare,           // dst <- lhs op rhs, positioned at constants[k]
+      negate,            // dst <- -lhs, positioned at constants[k]
+      affirm,            // dst <- +lhs, positioned at constants[k]
+      jump_if_false,     // if lhs is false, go to instruction k
+      jump_unless_false  // if lhs isn't false, go to instruction k
+    };
+
+    Opcode code;
+    Node::Type op;
+    unsigned char dst;
+    unsigned char lhs;
+    unsigned char rhs;
+    size_t k;
+  };
+
+  struct Constant {
+    Node node;
+    double number; // value of textual numbers and dimensions
+    Token unit;    // unit of textual dimensions
+    vector<size_t> path; // from the program's root to operands it evaluates
+                         // and to unary operators
+  };
+
+  struct Program {
+    enum { max_registers = 16 };
+
+    vector<Instruction> code;
+    vector<Constant> constants;
+    size_t registers; // the result ends up in register 0
+
+    Program()
+    : code(vector<Instruction>()), constants(vector<Constant>()),
+      registers(0)
+    { }
+  };
+
+}
@@ -1,6 +1,7 @@
 #include "context.hpp"
 #include <iostream>
 #include <unistd.h>
+#include <algorithm>
 #include "prelexer.hpp"
 using std::cerr; using std::endl;
 
@@ -40,17 +41,98 @@ namespace Sass {
     // }
   }
   
-  Context::Context(const char* paths_str)
+  // Source paths are stored once per Context; nodes and errors refer to them
+  // by index. Id 0 is reserved for nodes that don't come from a file.
+  size_t Context::file_id(const string& path)
+  {
+    if (path.empty()) return 0;
+    map<string, size_t>::iterator it = file_ids.find(path);
+    if (it != file_ids.end()) return it->second;
+    size_t id = file_paths.size();
+    file_paths.push_back(path);
+    file_ids[path] = id;
+    return id;
+  }
+
+  // Nodes and errors only record offsets into their file's text, so lexing
+  // doesn't have to count lines as it goes. The line an offset is on is
+  // found by searching the file's newlines when something needs to say,
+  // which is usually never.
+  void Context::set_source(size_t file, const Token& text)
+  {
+    if (file >= file_sources.size()) {
+      file_sources.resize(file + 1, Token::make());
+      newlines.resize(file + 1);
+    }
+    // text that's reparsed later (see eval) reuses its file's id
+    if (!file_sources[file].begin) file_sources[file] = text;
+  }
+
+  size_t Context::line_of(size_t file, size_t offset)
+  {
+    if (file >= file_sources.size() || !file_sources[file].begin) return 0;
+    vector<unsigned int>& index = newlines[file];
+    if (index.empty()) {
+      const char* text = file_sources[file].begin;
+      const char* end  = file_sources[file].end;
+      Prelexer::scan_text(text, end);
+      for (const char* p = Prelexer::find_char(text, '\n'); p < end && *p; p = Prelexer::find_char(p + 1, '\n')) {
+        index.push_back(p - text);
+      }
+      index.push_back(end - text); // so an indexed file never looks unindexed
+    }
+    return std::lower_bound(index.begin(), index.end(), offset) - index.begin() + 1;
+  }
+
+  // Variable, mixin and function names are interned the same way, so that
+  // environments can be keyed by integers instead of source text. Id 0 means
+  // the node doesn't have a name of its own (e.g. an interpolated one).
+  size_t Context::symbol(const string& name)
+  {
+    map<string, size_t>::iterator it = symbol_ids.find(name);
+    if (it != symbol_ids.end()) return it->second;
+    size_t id = symbol_names.size();
+    symbol_names.push_back(name);
+    symbol_ids[name] = id;
+    return id;
+  }
+
+  size_t Context::symbol(const Token& name)
+  { return symbol(name.to_string()); }
+
+  Context::Context(const char* paths_str, size_t max_depth)
   : global_env(Environment()),
-    function_env(map<pair<string, size_t>, Function>()),
+    function_env(map<pair<size_t, size_t>, Function>()),
     extensions(multimap<Node, Node>()),
     pending_extensions(vector<pair<Node, Node> >()),
     source_refs(vector<char*>()),
     include_paths(vector<string>()),
+    file_paths(vector<string>(1)),
+    file_ids(map<string, size_t>()),
+    file_sources(vector<Token>()),
+    newlines(vector<vector<unsigned int> >()),
+    symbol_names(vector<string>(1)),
+    symbol_ids(map<string, size_t>()),
+    scopes(vector<Scope>(1)),
+    programs(vector<Program>()),
+    pruned(vector<Node>()),
+    memo(map<pair<const Function*, string>, Node>()),
+    purity(map<const Function*, bool>()),
+    memo_hits(0),
+    memo_misses(0),
+    expansions(map<pair<size_t, string>, Node>()),
+    mixin_purity(map<size_t, bool>()),
+    expansion_hits(0),
+    expansion_misses(0),
+    deferred(vector<size_t>()),
+    readers(vector<vector<size_t> >()),
     new_Node(Node_Factory()),
+    depth(0),
+    max_depth(max_depth),
     ref_count(0),
     has_extensions(false)
   {
+    Node::max_nesting = max_depth;
     register_functions();
     collect_include_paths(paths_str);
   }
@@ -68,13 +150,13 @@ namespace Sass {
   inline void Context::register_function(Function_Descriptor d, Primitive ip)
   {
     Function f(d, ip);
-    function_env[pair<string, size_t>(f.name, f.parameters.size())] = f;
+    function_env[pair<size_t, size_t>(symbol(f.name), f.parameters.size())] = f;
   }
   
   inline void Context::register_function(Function_Descriptor d, Primitive ip, size_t arity)
   {
     Function f(d, ip);
-    function_env[pair<string, size_t>(f.name, arity)] = f;
+    function_env[pair<size_t, size_t>(symbol(f.name), arity)] = f;
   }
   
   void Context::register_functions()
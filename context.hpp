@@ -5,56 +5,176 @@
 #include <map>
 #include "node_factory.hpp"
 #include "functions.hpp"
+#include "bytecode.hpp"
 
 namespace Sass {
   using std::pair;
   using std::map;
   
+  // The static layout shared by every frame a block, mixin, function or loop
+  // body is evaluated in. Each name mentioned in the scope gets a slot; a
+  // slot that isn't bound at runtime defers to the nearest enclosing scope
+  // that can bind the same name. Built by resolve (see eval_apply.cpp).
+  struct Scope {
+    struct Link {
+      size_t depth; // frames to walk up, or 0 if no enclosing scope binds the name
+      size_t slot;
+    };
+    size_t parent;
+    map<size_t, size_t> slots; // symbol -> slot
+    vector<size_t> symbols;    // slot -> symbol
+    vector<bool> binds;        // whether frames of this scope can bind the slot
+    vector<Link> outer;
+
+    Scope(size_t parent = 0)
+    : parent(parent), slots(map<size_t, size_t>()), symbols(vector<size_t>()),
+      binds(vector<bool>()), outer(vector<Link>())
+    { }
+
+    size_t slot(size_t symbol)
+    {
+      map<size_t, size_t>::iterator it = slots.find(symbol);
+      if (it != slots.end()) return it->second;
+      size_t k = symbols.size();
+      symbols.push_back(symbol);
+      binds.push_back(false);
+      slots[symbol] = k;
+      return k;
+    }
+  };
+
   struct Environment {
-    map<Token, Node> current_frame;
+    vector<Node> slots;
+    const Scope* scope;
     Environment* parent;
     Environment* global;
     
     Environment()
-    : current_frame(map<Token, Node>()), parent(0), global(0)
+    : slots(vector<Node>()), scope(0), parent(0), global(0)
+    { }
+
+    Environment(const Scope& s)
+    : slots(vector<Node>(s.symbols.size())), scope(&s), parent(0), global(0)
     { }
+
+    void enter(const Scope& s)
+    {
+      scope = &s;
+      slots.resize(s.symbols.size());
+    }
     
+    // unbind everything, so that the frame can be used again
+    void reset()
+    {
+      for (size_t i = 0, S = slots.size(); i < S; ++i) slots[i] = Node();
+    }
+
     void link(Environment& env)
     {
       parent = &env;
       global = parent->global ? parent->global : parent;
     }
-    
-    bool query(const Token& key) const
+
+    // Whether a resolved name can be looked up directly. Names that weren't
+    // resolved for this scope (default arguments are evaluated in the
+    // caller's environment) are looked up by symbol instead.
+    bool resolved(Node name) const
+    { return name.slot() < slots.size() && scope->symbols[name.slot()] == name.symbol(); }
+
+    Node* find(size_t symbol)
     {
-      if (current_frame.count(key)) return true;
-      else if (parent)              return parent->query(key);
-      else                          return false;
+      for (Environment* frame = this; frame; frame = frame->parent) {
+        if (!frame->scope) continue;
+        map<size_t, size_t>::const_iterator it = frame->scope->slots.find(symbol);
+        if (it != frame->scope->slots.end() && !frame->slots[it->second].is_null_ptr()) {
+          return &frame->slots[it->second];
+        }
+      }
+      return 0;
     }
-    
-    Node& operator[](const Token& key)
+
+    // the innermost binding of a name, or 0 if it's unbound
+    Node* lookup(Node name)
+    {
+      if (!resolved(name)) return find(name.symbol());
+      Environment* frame = this;
+      size_t k = name.slot();
+      while (frame->slots[k].is_null_ptr()) {
+        const Scope::Link& up = frame->scope->outer[k];
+        if (!up.depth) return 0;
+        for (size_t d = up.depth; d; --d) frame = frame->parent;
+        k = up.slot;
+      }
+      return &frame->slots[k];
+    }
+
+    // Where an assignment to a name should go: its innermost binding if
+    // there is one, otherwise a new binding in this frame.
+    Node* binding(Node name)
     {
-      if (current_frame.count(key)) return current_frame[key];
-      else if (parent)              return (*parent)[key];
-      else                          return current_frame[key];
+      Node* existing = lookup(name);
+      if (existing)         return existing;
+      if (resolved(name))   return &slots[name.slot()];
+      map<size_t, size_t>::const_iterator it = scope->slots.find(name.symbol());
+      return it != scope->slots.end() ? &slots[it->second] : 0;
     }
   };
 
   struct Context {
     Environment global_env;
-    map<pair<string, size_t>, Function> function_env;
+    map<pair<size_t, size_t>, Function> function_env; // keyed by (symbol, arity)
     multimap<Node, Node> extensions;
     vector<pair<Node, Node> > pending_extensions;
     vector<char*> source_refs; // all the source c-strings
     vector<string> include_paths;
+    vector<string> file_paths; // indexed by the file ids stored in nodes
+    map<string, size_t> file_ids;
+    // the text of each file, and where its newlines are (indexed the first
+    // time a line number is asked for); see line_of
+    vector<Token> file_sources;
+    vector<vector<unsigned int> > newlines;
+    vector<string> symbol_names; // indexed by the symbol ids stored in nodes
+    map<string, size_t> symbol_ids;
+    vector<Scope> scopes; // the global scope comes first
+    vector<Program> programs; // compiled expressions; see compile in eval_apply.cpp
+    vector<Node> pruned; // unused top-level definitions and assignments; see prune
+                         // (counted in sass_stats)
+    // results of calls to pure functions, keyed by the function and the
+    // values of its arguments; see apply_function in eval_apply.cpp
+    map<pair<const Function*, string>, Node> memo;
+    map<const Function*, bool> purity;
+    size_t memo_hits;   // reported in sass_stats
+    size_t memo_misses;
+    // bodies of pure mixins as expanded, keyed by the mixin's scope, the
+    // values of its arguments and the selector prefix; see apply_mixin
+    static const size_t max_expansions = 4096;
+    map<pair<size_t, string>, Node> expansions;
+    map<size_t, bool> mixin_purity;
+    size_t expansion_hits;
+    size_t expansion_misses;
+    // global slots of top-level assignments that haven't been evaluated
+    // yet, and for each global slot, the deferred assignments that read it;
+    // see defer in eval_apply.cpp
+    vector<size_t> deferred;
+    vector<vector<size_t> > readers;
     Node_Factory new_Node;
+    // each level takes up to a kilobyte or so of stack, so this leaves
+    // room to spare on a 1MB thread stack; sass_options::max_depth sets it
+    static const size_t default_max_depth = 512;
+    size_t depth;     // calls of eval and function_eval in progress
+    size_t max_depth; // past which evaluation fails rather than overflow the stack
     size_t ref_count;
     string sass_path;
     string css_path;
     bool has_extensions;
 
     void collect_include_paths(const char* paths_str);
-    Context(const char* paths_str = 0);
+    size_t file_id(const string& path);
+    void set_source(size_t file, const Token& text);
+    size_t line_of(size_t file, size_t offset);
+    size_t symbol(const string& name);
+    size_t symbol(const Token& name);
+    Context(const char* paths_str = 0, size_t max_depth = default_max_depth);
     ~Context();
     
     void register_function(Function_Descriptor d, Primitive ip);
@@ -13,14 +13,17 @@ namespace Sass {
 
   Document::Document(const Document& doc)
   : path(doc.path),
+    file(doc.file),
     source(doc.source),
     position(doc.position),
     end(doc.end),
-    line(doc.line),
+    origin(doc.origin),
+    anchor(doc.anchor),
     own_source(doc.own_source),
     context(doc.context),
     root(doc.root),
-    lexed(doc.lexed)
+    lexed(doc.lexed),
+    selector_tokens(vector<Selector_Token>())
   { ++doc.context.ref_count; }
 
   Document::~Document()
@@ -64,14 +67,17 @@ namespace Sass {
 
     Document doc(ctx);
     doc.path        = path;
-    doc.line = 1;
-    doc.root        = ctx.new_Node(Node::root, path, 1, 0);
+    doc.file        = ctx.file_id(path);
+    doc.origin      = source;
+    doc.anchor      = 0;
+    doc.root        = ctx.new_Node(Node::root, doc.file, 0, 0);
     doc.lexed       = Token::make();
     doc.own_source  = true;
     doc.source      = source;
     doc.end         = end;
     doc.position    = source;
     doc.context.source_refs.push_back(source);
+    doc.context.set_source(doc.file, Token::make(source, end));
 
     return doc;
   }
@@ -80,24 +86,31 @@ namespace Sass {
   {
     Document doc(ctx);
     doc.path = path;
-    doc.line = 1;
-    doc.root = ctx.new_Node(Node::root, path, 1, 0);
+    doc.file = ctx.file_id(path);
+    doc.origin = src;
+    doc.anchor = 0;
+    doc.root = ctx.new_Node(Node::root, doc.file, 0, 0);
     doc.lexed = Token::make();
     doc.own_source = own_source;
     doc.source = src;
     doc.end = src + std::strlen(src);
     doc.position = src;
     if (own_source) doc.context.source_refs.push_back(src);
+    doc.context.set_source(doc.file, Token::make(doc.source, doc.end));
 
     return doc;
   }
 
-  Document Document::make_from_token(Context& ctx, Token t, string path, size_t line_number)
+  // Tokens are parts of some other document's source, so offsets are still
+  // measured from the start of its file.
+  Document Document::make_from_token(Context& ctx, Token t, string path, const char* origin, size_t anchor)
   {
     Document doc(ctx);
     doc.path = path;
-    doc.line = line_number;
-    doc.root = ctx.new_Node(Node::root, path, 1, 0);
+    doc.file = ctx.file_id(path);
+    doc.origin = origin;
+    doc.anchor = anchor;
+    doc.root = ctx.new_Node(Node::root, doc.file, 0, 0);
     doc.lexed = Token::make();
     doc.own_source = false;
     doc.source = const_cast<char*>(t.begin);
@@ -107,11 +120,11 @@ namespace Sass {
     return doc;
   }
   
-  void Document::throw_syntax_error(string message, size_t ln)
-  { throw Error(Error::syntax, path, ln ? ln : line, message); }
+  void Document::throw_syntax_error(string message, size_t at)
+  { throw Error(Error::syntax, file, at ? at : offset(), message); }
   
-  void Document::throw_read_error(string message, size_t ln)
-  { throw Error(Error::read, path, ln ? ln : line, message); }
+  void Document::throw_read_error(string message, size_t at)
+  { throw Error(Error::read, file, at ? at : offset(), message); }
   
   using std::string;
   using std::stringstream;
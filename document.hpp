@@ -12,9 +12,23 @@
 #include "context.hpp"
 #endif
 
+// A token of a selector as the lookahead scanned it: where it starts (past
+// any comments and whitespace) and ends, whether whitespace comes right
+// before it, and what it can be told apart as.
+struct Selector_Token {
+  enum Kind { simple, pseudo, type, universal, backref, combinator, comma, other };
+
+  const char* begin;
+  const char* end;
+  bool spaced;
+  Kind kind;
+};
+
 struct Selector_Lookahead {
   const char* found;
   bool has_interpolants;
+  const Selector_Token* tokens; // valid until the next lookahead
+  size_t token_count;
 };
 
 namespace Sass {
@@ -27,16 +41,23 @@ namespace Sass {
     enum CSS_Style { nested, expanded, compact, compressed, echo };
     
     string path;
+    size_t file;
     char* source;
     const char* position;
     const char* end;
-    size_t line;
+    // Nodes record where they come from as an offset into their file's text
+    // rather than a line number; see Context::line_of. Text that isn't part
+    // of the file (a selector put together by interpolation, say) has no
+    // origin, and everything in it is attributed to the anchor instead.
+    const char* origin;
+    size_t anchor;
     bool own_source;
 
     Context& context;
     
     Node root;
     Token lexed;
+    vector<Selector_Token> selector_tokens; // see lookahead_for_selector
 
   private:
     // force the use of the "make_from_..." factory funtions
@@ -47,12 +68,16 @@ namespace Sass {
 
     static Document make_from_file(Context& ctx, string path);
     static Document make_from_source_chars(Context& ctx, char* src, string path = "", bool own_source = false);
-    static Document make_from_token(Context& ctx, Token t, string path = "", size_t line_number = 1);
+    static Document make_from_token(Context& ctx, Token t, string path = "", const char* origin = 0, size_t anchor = 0);
+
+    size_t offset() const
+    { return origin ? position - origin : anchor; }
 
     template <prelexer mx>
     const char* peek(const char* start = 0)
     {
       if (!start) start = position;
+      scan_text(source, end);
       const char* after_whitespace;
       if (mx == block_comment) {
         after_whitespace = // start;
@@ -88,6 +113,7 @@ namespace Sass {
     template <prelexer mx>
     const char* lex()
     {
+      scan_text(source, end);
       const char* after_whitespace;
       if (mx == block_comment) {
         after_whitespace = // position;
@@ -99,7 +125,6 @@ namespace Sass {
       else if (mx == spaces) {
         after_whitespace = spaces(position);
         if (after_whitespace) {
-          line += count_interval<'\n'>(position, after_whitespace);
           lexed = Token::make(position, after_whitespace);
           return position = after_whitespace;
         }
@@ -115,7 +140,6 @@ namespace Sass {
       }
       const char* after_token = mx(after_whitespace);
       if (after_token) {
-        line += count_interval<'\n'>(position, after_token);
         lexed = Token::make(after_whitespace, after_token);
         return position = after_token;
       }
@@ -142,6 +166,10 @@ namespace Sass {
     Node parse_selector();
     Node parse_selector_combinator();
     Node parse_simple_selector_sequence();
+    Node parse_selector_group(const Selector_Token* tok, const Selector_Token* last);
+    Node parse_selector(const Selector_Token*& tok, const Selector_Token* last);
+    Node parse_simple_selector_sequence(const Selector_Token*& tok, const Selector_Token* last);
+    Node parse_simple_selector(const Selector_Token*& tok, const Selector_Token* last);
     Node parse_simple_selector();
     Node parse_pseudo();
     Node parse_attribute_selector();
@@ -173,8 +201,8 @@ namespace Sass {
 
     Selector_Lookahead lookahead_for_selector(const char* start = 0);
     
-    void throw_syntax_error(string message, size_t ln = 0);
-    void throw_read_error(string message, size_t ln = 0);
+    void throw_syntax_error(string message, size_t at = 0);
+    void throw_read_error(string message, size_t at = 0);
     
     string emit_css(CSS_Style style);
 
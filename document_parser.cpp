@@ -1,70 +1,158 @@
 #include "document.hpp"
 #include "error.hpp"
 #include <iostream>
+#include <cstring>
 
 namespace Sass {
   using namespace std;
 
+  // Numeric literals and hex colors get their values read once, here,
+  // instead of every time they're evaluated.
+
+  static unsigned long xdigit_value(char c)
+  { return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10; }
+
+  static Node literal(Context& context, Node::Type type, size_t file, size_t offset, const Token& t)
+  {
+    if (type != Node::textual_hex) return context.new_Node(type, file, offset, t, t.to_number());
+    // #rgb is short for #rrggbb
+    const char* hext = t.begin + 1;
+    bool longhand = t.length() == 7;
+    unsigned long rgb = 0;
+    for (size_t i = 0; i < 6; ++i) rgb = rgb * 16 + xdigit_value(hext[longhand ? i : i/2]);
+    return context.new_Node(type, file, offset, t, static_cast<double>(rgb));
+  }
+
+  // Statements are told apart by their first significant character, and
+  // at-rules by their keyword, which is looked up in a perfect hash rather
+  // than tried against each directive in turn.
+
+  enum At_Rule {
+    at_other, at_import, at_media, at_mixin, at_function, at_return,
+    at_include, at_extend, at_if, at_for, at_each, at_while, at_warn
+  };
+
+  struct At_Keyword {
+    const char* name;
+    size_t      length;
+    At_Rule     rule;
+  };
+
+  static size_t at_keyword_hash(const char* kwd, size_t len)
+  {
+    return (2*len + static_cast<unsigned char>(kwd[0])
+                  + 3*static_cast<unsigned char>(kwd[len-1])) & 31;
+  }
+
+  static const At_Keyword at_keywords[32] = {
+    { "function", 8, at_function }, { "mixin", 5, at_mixin },
+    { "for", 3, at_for },           { 0, 0, at_other },
+    { 0, 0, at_other },             { "each", 4, at_each },
+    { "include", 7, at_include },   { 0, 0, at_other },
+    { "return", 6, at_return },     { "warn", 4, at_warn },
+    { 0, 0, at_other },             { 0, 0, at_other },
+    { 0, 0, at_other },             { 0, 0, at_other },
+    { 0, 0, at_other },             { 0, 0, at_other },
+    { "while", 5, at_while },       { "import", 6, at_import },
+    { 0, 0, at_other },             { 0, 0, at_other },
+    { 0, 0, at_other },             { 0, 0, at_other },
+    { 0, 0, at_other },             { 0, 0, at_other },
+    { 0, 0, at_other },             { 0, 0, at_other },
+    { "media", 5, at_media },       { 0, 0, at_other },
+    { 0, 0, at_other },             { "extend", 6, at_extend },
+    { 0, 0, at_other },             { "if", 2, at_if }
+  };
+
+  // src points at the '@'
+  static At_Rule at_rule(const char* src)
+  {
+    const char* kwd = src + 1;
+    const char* kwd_end = identifier(kwd);
+    if (!kwd_end) return at_other;
+    size_t len = kwd_end - kwd;
+    const At_Keyword& entry = at_keywords[at_keyword_hash(kwd, len)];
+    if (entry.length == len && std::memcmp(entry.name, kwd, len) == 0) return entry.rule;
+    return at_other;
+  }
+
   void Document::parse_scss()
   {
     lex< optional_spaces >();
     Selector_Lookahead lookahead_result;
     while (position < end) {
       if (lex< block_comment >()) {
-        root << context.new_Node(Node::comment, path, line, lexed);
-      }
-      else if (peek< import >()) {
-        Node importee(parse_import());
-        if (importee.type() == Node::css_import) root << importee;
-        else                                     root += importee;
-        if (!lex< exactly<';'> >()) throw_syntax_error("top-level @import directive must be terminated by ';'");
+        root << context.new_Node(Node::comment, file, offset(), lexed);
+        lex< optional_spaces >();
+        continue;
+      }
+      const char* stmt = spaces_and_comments(position);
+      if (*stmt == '@') {
+        switch (at_rule(stmt)) {
+          case at_import: {
+            Node importee(parse_import());
+            if (importee.type() == Node::css_import) root << importee;
+            else                                     root += importee;
+            if (!lex< exactly<';'> >()) throw_syntax_error("top-level @import directive must be terminated by ';'");
+          } break;
+          case at_mixin: {
+            root << parse_mixin_definition();
+          } break;
+          case at_function: {
+            root << parse_function_definition();
+          } break;
+          case at_include: {
+            root << parse_mixin_call();
+            if (!lex< exactly<';'> >()) throw_syntax_error("top-level @include directive must be terminated by ';'");
+          } break;
+          case at_if: {
+            root << parse_if_directive(Node(), Node::none);
+          } break;
+          case at_for: {
+            root << parse_for_directive(Node(), Node::none);
+          } break;
+          case at_each: {
+            root << parse_each_directive(Node(), Node::none);
+          } break;
+          case at_while: {
+            root << parse_while_directive(Node(), Node::none);
+          } break;
+          case at_media: {
+            root << parse_media_query(Node::none);
+          } break;
+          case at_warn: {
+            root << parse_warning();
+            if (!lex< exactly<';'> >()) throw_syntax_error("top-level @warn directive must be terminated by ';'");
+          } break;
+          default: {
+            if (!peek< directive >(stmt)) {
+              lex< spaces_and_comments >();
+              throw_syntax_error("invalid top-level expression");
+            }
+            Node dir(parse_directive(Node(), Node::none));
+            if (dir.type() == Node::blockless_directive) {
+              if (!lex< exactly<';'> >()) throw_syntax_error("top-level blockless directive must be terminated by ';'");
+            }
+            root << dir;
+          } break;
+        }
       }
-      else if (peek< mixin >() || peek< exactly<'='> >()) {
+      else if (*stmt == '=') {
         root << parse_mixin_definition();
       }
-      else if (peek< function >()) {
-        root << parse_function_definition();
-      }
-      else if (peek< variable >()) {
+      else if (*stmt == '$' && peek< variable >(stmt)) {
         root << parse_assignment();
         if (!lex< exactly<';'> >()) throw_syntax_error("top-level variable binding must be terminated by ';'");
       }
-      else if (peek< sequence< identifier, optional_spaces, exactly<':'>, optional_spaces, exactly<'{'> > >(position)) {
+      else if (peek< sequence< identifier, optional_spaces, exactly<':'>, optional_spaces, exactly<'{'> > >(stmt)) {
         root << parse_propset();
       }
-      else if ((lookahead_result = lookahead_for_selector(position)).found) {
+      else if ((lookahead_result = lookahead_for_selector(stmt)).found) {
         root << parse_ruleset(lookahead_result);
       }
-      else if (peek< include >() || peek< exactly<'+'> >()) {
+      else if (*stmt == '+') {
         root << parse_mixin_call();
         if (!lex< exactly<';'> >()) throw_syntax_error("top-level @include directive must be terminated by ';'");
       }
-      else if (peek< if_directive >()) {
-        root << parse_if_directive(Node(), Node::none);
-      }
-      else if (peek< for_directive >()) {
-        root << parse_for_directive(Node(), Node::none);
-      }
-      else if (peek< each_directive >()) {
-        root << parse_each_directive(Node(), Node::none);
-      }
-      else if (peek< while_directive >()) {
-        root << parse_while_directive(Node(), Node::none);
-      }
-      else if (peek< media >()) {
-        root << parse_media_query(Node::none);
-      }
-      else if (peek< warn >()) {
-        root << parse_warning();
-        if (!lex< exactly<';'> >()) throw_syntax_error("top-level @warn directive must be terminated by ';'");
-      }
-      else if (peek< directive >()) {
-        Node dir(parse_directive(Node(), Node::none));
-        if (dir.type() == Node::blockless_directive) {
-          if (!lex< exactly<';'> >()) throw_syntax_error("top-level blockless directive must be terminated by ';'");
-        }
-        root << dir;
-      }
       else {
         lex< spaces_and_comments >();
         if (position >= end) break;
@@ -81,7 +169,7 @@ namespace Sass {
     {
       if (peek< string_constant >()) {
         Node schema(parse_string());
-        Node importee(context.new_Node(Node::css_import, path, line, 1));
+        Node importee(context.new_Node(Node::css_import, file, offset(), 1));
         importee << schema;
         if (!lex< exactly<')'> >()) throw_syntax_error("unterminated url in @import directive");
         return importee;
@@ -90,8 +178,8 @@ namespace Sass {
         const char* beg = position;
         const char* end = find_first< exactly<')'> >(position);
         if (!end) throw_syntax_error("unterminated url in @import directive");
-        Node path_node(context.new_Node(Node::identifier, path, line, Token::make(beg, end)));
-        Node importee(context.new_Node(Node::css_import, path, line, 1));
+        Node path_node(context.new_Node(Node::identifier, file, offset(), Token::make(beg, end)));
+        Node importee(context.new_Node(Node::css_import, file, offset(), 1));
         importee << path_node;
         position = end;
         lex< exactly<')'> >();
@@ -120,11 +208,12 @@ namespace Sass {
   {
     lex< mixin >() || lex< exactly<'='> >();
     if (!lex< identifier >()) throw_syntax_error("invalid name in @mixin directive");
-    Node name(context.new_Node(Node::identifier, path, line, lexed));
+    Node name(context.new_Node(Node::identifier, file, offset(), lexed));
+    name.symbol() = context.symbol(lexed);
     Node params(parse_parameters());
     if (!peek< exactly<'{'> >()) throw_syntax_error("body for mixin " + name.token().to_string() + " must begin with a '{'");
     Node body(parse_block(Node(), Node::mixin));
-    Node the_mixin(context.new_Node(Node::mixin, path, line, 3));
+    Node the_mixin(context.new_Node(Node::mixin, file, offset(), 3));
     the_mixin << name << params << body;
     return the_mixin;
   }
@@ -133,20 +222,21 @@ namespace Sass {
   {
 
     lex< function >();
-    size_t func_line = line;
+    size_t func_offset = offset();
     if (!lex< identifier >()) throw_syntax_error("name required for function definition");
-    Node name(context.new_Node(Node::identifier, path, line, lexed));
+    Node name(context.new_Node(Node::identifier, file, offset(), lexed));
+    name.symbol() = context.symbol(lexed);
     Node params(parse_parameters());
     if (!peek< exactly<'{'> >()) throw_syntax_error("body for function " + name.to_string() + " must begin with a '{'");
     Node body(parse_block(Node(), Node::function));
-    Node func(context.new_Node(Node::function, path, func_line, 3));
+    Node func(context.new_Node(Node::function, file, func_offset, 3));
     func << name << params << body;
     return func;
   }
 
   Node Document::parse_parameters()
   {
-    Node params(context.new_Node(Node::parameters, path, line, 0));
+    Node params(context.new_Node(Node::parameters, file, offset(), 0));
     Token name(lexed);
     if (lex< exactly<'('> >()) {
       if (peek< variable >()) {
@@ -164,10 +254,11 @@ namespace Sass {
 
   Node Document::parse_parameter() {
     lex< variable >();
-    Node var(context.new_Node(Node::variable, path, line, lexed));
+    Node var(context.new_Node(Node::variable, file, offset(), lexed));
+    var.symbol() = context.symbol(lexed);
     if (lex< exactly<':'> >()) { // default value
       Node val(parse_space_list());
-      Node par_and_val(context.new_Node(Node::assignment, path, line, 2));
+      Node par_and_val(context.new_Node(Node::assignment, file, offset(), 2));
       par_and_val << var << val;
       return par_and_val;
     }
@@ -182,9 +273,10 @@ namespace Sass {
   {
     lex< include >() || lex< exactly<'+'> >();
     if (!lex< identifier >()) throw_syntax_error("invalid name in @include directive");
-    Node name(context.new_Node(Node::identifier, path, line, lexed));
+    Node name(context.new_Node(Node::identifier, file, offset(), lexed));
+    name.symbol() = context.symbol(lexed);
     Node args(parse_arguments());
-    Node the_call(context.new_Node(Node::expansion, path, line, 2));
+    Node the_call(context.new_Node(Node::expansion, file, offset(), 2));
     the_call << name << args;
     return the_call;
   }
@@ -192,7 +284,7 @@ namespace Sass {
   Node Document::parse_arguments()
   {
     Token name(lexed);
-    Node args(context.new_Node(Node::arguments, path, line, 0));
+    Node args(context.new_Node(Node::arguments, file, offset(), 0));
     if (lex< exactly<'('> >()) {
       if (!peek< exactly<')'> >(position)) {
         Node arg(parse_argument());
@@ -213,10 +305,11 @@ namespace Sass {
   {
     if (peek< sequence < variable, spaces_and_comments, exactly<':'> > >()) {
       lex< variable >();
-      Node var(context.new_Node(Node::variable, path, line, lexed));
+      Node var(context.new_Node(Node::variable, file, offset(), lexed));
+      var.symbol() = context.symbol(lexed);
       lex< exactly<':'> >();
       Node val(parse_space_list());
-      Node assn(context.new_Node(Node::assignment, path, line, 2));
+      Node assn(context.new_Node(Node::assignment, file, offset(), 2));
       assn << var << val;
       return assn;
     }
@@ -228,22 +321,23 @@ namespace Sass {
   Node Document::parse_assignment()
   {
     lex< variable >();
-    Node var(context.new_Node(Node::variable, path, line, lexed));
+    Node var(context.new_Node(Node::variable, file, offset(), lexed));
+    var.symbol() = context.symbol(lexed);
     if (!lex< exactly<':'> >()) throw_syntax_error("expected ':' after " + lexed.to_string() + " in assignment statement");
     Node val(parse_list());
-    Node assn(context.new_Node(Node::assignment, path, line, 2));
+    Node assn(context.new_Node(Node::assignment, file, offset(), 2));
     assn << var << val;
-    if (lex< default_flag >()) assn << context.new_Node(Node::none, path, line, 0);
+    if (lex< default_flag >()) assn << context.new_Node(Node::none, file, offset(), 0);
     return assn;
   }
   
   Node Document::parse_propset()
   {
     lex< identifier >();
-    Node property_segment(context.new_Node(Node::identifier, path, line, lexed));
+    Node property_segment(context.new_Node(Node::identifier, file, offset(), lexed));
     lex< exactly<':'> >();
     lex< exactly<'{'> >();
-    Node block(context.new_Node(Node::block, path, line, 1));
+    Node block(context.new_Node(Node::block, file, offset(), 1));
     while (!lex< exactly<'}'> >()) {
       if (peek< sequence< identifier, optional_spaces, exactly<':'>, optional_spaces, exactly<'{'> > >(position)) {
         block << parse_propset();
@@ -254,7 +348,7 @@ namespace Sass {
       }
     }
     if (block.empty()) throw_syntax_error("namespaced property cannot be empty");
-    Node propset(context.new_Node(Node::propset, path, line, 2));
+    Node propset(context.new_Node(Node::propset, file, offset(), 2));
     propset << property_segment;
     propset << block;
     return propset;
@@ -262,12 +356,18 @@ namespace Sass {
 
   Node Document::parse_ruleset(Selector_Lookahead lookahead, Node::Type inside_of)
   {
-    Node ruleset(context.new_Node(Node::ruleset, path, line, 3));
+    Node ruleset(context.new_Node(Node::ruleset, file, offset(), 3));
     if (lookahead.has_interpolants) {
       ruleset << parse_selector_schema(lookahead.found);
     }
     else {
-      ruleset << parse_selector_group();
+      Node sel;
+      if (lookahead.tokens) {
+        const char* start = position;
+        sel = parse_selector_group(lookahead.tokens, lookahead.tokens + lookahead.token_count);
+        if (sel.is_null_ptr()) position = start;
+      }
+      ruleset << (sel.is_null_ptr() ? parse_selector_group() : sel);
     }
     if (!peek< exactly<'{'> >()) throw_syntax_error("expected a '{' after the selector");
     ruleset << parse_block(ruleset, inside_of);
@@ -280,22 +380,22 @@ namespace Sass {
   {    
     const char* i = position;
     const char* p;
-    Node schema(context.new_Node(Node::selector_schema, path, line, 1));
+    Node schema(context.new_Node(Node::selector_schema, file, offset(), 1));
 
     while (i < end_of_selector) {
       p = find_first_in_interval< exactly<hash_lbrace> >(i, end_of_selector);
       if (p) {
         // accumulate the preceding segment if there is one
-        if (i < p) schema << context.new_Node(Node::identifier, path, line, Token::make(i, p));
+        if (i < p) schema << context.new_Node(Node::identifier, file, offset(), Token::make(i, p));
         // find the end of the interpolant and parse it
         const char* j = find_first_in_interval< exactly<rbrace> >(p, end_of_selector);
-        Node interp_node(Document::make_from_token(context, Token::make(p+2, j), path, line).parse_list());
+        Node interp_node(Document::make_from_token(context, Token::make(p+2, j), path, origin, anchor).parse_list());
         interp_node.should_eval() = true;
         schema << interp_node;
         i = j + 1;
       }
       else { // no interpolants left; add the last segment if there is one
-        if (i < end_of_selector) schema << context.new_Node(Node::identifier, path, line, Token::make(i, end_of_selector));
+        if (i < end_of_selector) schema << context.new_Node(Node::identifier, file, offset(), Token::make(i, end_of_selector));
         break;
       }
     }
@@ -308,12 +408,117 @@ namespace Sass {
     Node sel1(parse_selector());
     if (!peek< exactly<','> >()) return sel1;
     
-    Node group(context.new_Node(Node::selector_group, path, line, 2));
+    Node group(context.new_Node(Node::selector_group, file, offset(), 2));
     group << sel1;
     while (lex< exactly<','> >()) group << parse_selector();
     return group;
   }
 
+  // The same grammar as above, over the tokens the lookahead found rather
+  // than the text. Attribute selectors and functional pseudo-classes are
+  // parsed from the text, after which the tokens are picked up again where
+  // the text parser stopped. Anything the grammar would reject (or that
+  // doesn't line up with the tokens afterwards) comes back null, to be
+  // parsed from the text in full. Each node is made where the text parser
+  // would make it, so it records the same offset.
+  Node Document::parse_selector_group(const Selector_Token* tok, const Selector_Token* last)
+  {
+    Node sel1(parse_selector(tok, last));
+    if (sel1.is_null_ptr() || tok == last) return sel1;
+
+    Node group(context.new_Node(Node::selector_group, file, offset(), 2));
+    group << sel1;
+    while (tok != last) {
+      if (tok->kind != Selector_Token::comma) return Node();
+      position = tok->end;
+      lexed = Token::make(tok->begin, tok->end);
+      Node sel(parse_selector(++tok, last));
+      if (sel.is_null_ptr()) return sel;
+      group << sel;
+    }
+    return group;
+  }
+
+  Node Document::parse_selector(const Selector_Token*& tok, const Selector_Token* last)
+  {
+    Node seq1(parse_simple_selector_sequence(tok, last));
+    if (seq1.is_null_ptr() || tok == last || tok->kind == Selector_Token::comma) return seq1;
+
+    Node selector(context.new_Node(Node::selector, file, offset(), 2));
+    selector << seq1;
+
+    while (tok != last && tok->kind != Selector_Token::comma) {
+      Node seq(parse_simple_selector_sequence(tok, last));
+      if (seq.is_null_ptr()) return seq;
+      selector << seq;
+    }
+    return selector;
+  }
+
+  Node Document::parse_simple_selector_sequence(const Selector_Token*& tok, const Selector_Token* last)
+  {
+    if (tok == last) return Node();
+    Node simp1;
+    switch (tok->kind)
+    {
+      case Selector_Token::combinator: {
+        position = tok->end;
+        lexed = Token::make(tok->begin, tok->end);
+        ++tok;
+        return context.new_Node(Node::selector_combinator, file, offset(), lexed);
+      } break;
+
+      case Selector_Token::backref:
+      case Selector_Token::type:
+      case Selector_Token::universal: {
+        // a type or universal selector followed by a bar has a namespace
+        if (*tok->end == '|') return Node();
+        position = tok->end;
+        lexed = Token::make(tok->begin, tok->end);
+        ++tok;
+        simp1 = context.new_Node(lexed.begin[0] == '&' ? Node::backref : Node::simple_selector, file, offset(), lexed);
+      } break;
+
+      default: {
+        simp1 = parse_simple_selector(tok, last);
+        if (simp1.is_null_ptr()) return simp1;
+      } break;
+    }
+
+    if (tok == last || tok->spaced ||
+        tok->kind == Selector_Token::combinator ||
+        tok->kind == Selector_Token::comma)
+    { return simp1; }
+
+    Node seq(context.new_Node(Node::simple_selector_sequence, file, offset(), 2));
+    seq << simp1;
+
+    while (tok != last && !tok->spaced &&
+           tok->kind != Selector_Token::combinator &&
+           tok->kind != Selector_Token::comma) {
+      Node simp(parse_simple_selector(tok, last));
+      if (simp.is_null_ptr()) return simp;
+      seq << simp;
+    }
+    return seq;
+  }
+
+  Node Document::parse_simple_selector(const Selector_Token*& tok, const Selector_Token* last)
+  {
+    if (tok->kind == Selector_Token::simple ||
+        (tok->kind == Selector_Token::pseudo && *tok->end != '(')) {
+      position = tok->end;
+      lexed = Token::make(tok->begin, tok->end);
+      ++tok;
+      return context.new_Node(lexed.begin[0] == ':' ? Node::pseudo : Node::simple_selector, file, offset(), lexed);
+    }
+    if (tok->kind != Selector_Token::pseudo && *tok->begin != '[') return Node();
+    Node simp(parse_simple_selector());
+    while (tok != last && tok->begin < position) ++tok;
+    if ((tok - 1)->end != position) return Node();
+    return simp;
+  }
+
   Node Document::parse_selector()
   {
     Node seq1(parse_simple_selector_sequence());
@@ -321,7 +526,7 @@ namespace Sass {
         peek< exactly<')'> >() ||
         peek< exactly<'{'> >()) return seq1;
     
-    Node selector(context.new_Node(Node::selector, path, line, 2));
+    Node selector(context.new_Node(Node::selector, file, offset(), 2));
     selector << seq1;
 
     while (!peek< exactly<'{'> >() && !peek< exactly<','> >()) {
@@ -336,15 +541,15 @@ namespace Sass {
     if (lex< exactly<'+'> >() ||
         lex< exactly<'~'> >() ||
         lex< exactly<'>'> >())
-    { return context.new_Node(Node::selector_combinator, path, line, lexed); }
+    { return context.new_Node(Node::selector_combinator, file, offset(), lexed); }
     
     // check for backref or type selector, which are only allowed at the front
     Node simp1;
     if (lex< exactly<'&'> >()) {
-      simp1 = context.new_Node(Node::backref, path, line, lexed);
+      simp1 = context.new_Node(Node::backref, file, offset(), lexed);
     }
     else if (lex< alternatives< type_selector, universal > >()) {
-      simp1 = context.new_Node(Node::simple_selector, path, line, lexed);
+      simp1 = context.new_Node(Node::simple_selector, file, offset(), lexed);
     }
     else {
       simp1 = parse_simple_selector();
@@ -358,7 +563,7 @@ namespace Sass {
     { return simp1; }
 
     // otherwise, we have a sequence of simple selectors
-    Node seq(context.new_Node(Node::simple_selector_sequence, path, line, 2));
+    Node seq(context.new_Node(Node::simple_selector_sequence, file, offset(), 2));
     seq << simp1;
     
     while (!peek< spaces >(position) &&
@@ -378,13 +583,13 @@ namespace Sass {
   {
     lex< exactly<'+'> >() || lex< exactly<'~'> >() ||
     lex< exactly<'>'> >() || lex< ancestor_of >();
-    return context.new_Node(Node::selector_combinator, path, line, lexed);
+    return context.new_Node(Node::selector_combinator, file, offset(), lexed);
   }
   
   Node Document::parse_simple_selector()
   {
     if (lex< id_name >() || lex< class_name >()) {
-      return context.new_Node(Node::simple_selector, path, line, lexed);
+      return context.new_Node(Node::simple_selector, file, offset(), lexed);
     }
     else if (peek< exactly<':'> >(position)) {
       return parse_pseudo();
@@ -401,39 +606,39 @@ namespace Sass {
   
   Node Document::parse_pseudo() {
     if (lex< pseudo_not >()) {
-      Node ps_not(context.new_Node(Node::pseudo_negation, path, line, 2));
-      ps_not << context.new_Node(Node::value, path, line, lexed);
+      Node ps_not(context.new_Node(Node::pseudo_negation, file, offset(), 2));
+      ps_not << context.new_Node(Node::value, file, offset(), lexed);
       ps_not << parse_selector_group();
       lex< exactly<')'> >();
       return ps_not;
     }
     else if (lex< sequence< pseudo_prefix, functional > >()) {
-      Node pseudo(context.new_Node(Node::functional_pseudo, path, line, 2));
+      Node pseudo(context.new_Node(Node::functional_pseudo, file, offset(), 2));
       Token name(lexed);
-      pseudo << context.new_Node(Node::value, path, line, name);
+      pseudo << context.new_Node(Node::value, file, offset(), name);
       if (lex< alternatives< even, odd > >()) {
-        pseudo << context.new_Node(Node::value, path, line, lexed);
+        pseudo << context.new_Node(Node::value, file, offset(), lexed);
       }
       else if (peek< binomial >(position)) {
         lex< coefficient >();
-        pseudo << context.new_Node(Node::value, path, line, lexed);
+        pseudo << context.new_Node(Node::value, file, offset(), lexed);
         lex< exactly<'n'> >();
-        pseudo << context.new_Node(Node::value, path, line, lexed);
+        pseudo << context.new_Node(Node::value, file, offset(), lexed);
         lex< sign >();
-        pseudo << context.new_Node(Node::value, path, line, lexed);
+        pseudo << context.new_Node(Node::value, file, offset(), lexed);
         lex< digits >();
-        pseudo << context.new_Node(Node::value, path, line, lexed);
+        pseudo << context.new_Node(Node::value, file, offset(), lexed);
       }
       else if (lex< sequence< optional<sign>,
                               optional<digits>,
                               exactly<'n'> > >()) {
-        pseudo << context.new_Node(Node::value, path, line, lexed);
+        pseudo << context.new_Node(Node::value, file, offset(), lexed);
       }
       else if (lex< sequence< optional<sign>, digits > >()) {
-        pseudo << context.new_Node(Node::value, path, line, lexed);
+        pseudo << context.new_Node(Node::value, file, offset(), lexed);
       }
       else if (lex< identifier >()) {
-        pseudo << context.new_Node(Node::identifier, path, line, lexed);
+        pseudo << context.new_Node(Node::identifier, file, offset(), lexed);
       }
       else {
         throw_syntax_error("invalid argument to " + name.to_string() + "...)");
@@ -442,7 +647,7 @@ namespace Sass {
       return pseudo;
     }
     else if (lex < sequence< pseudo_prefix, identifier > >()) {
-      return context.new_Node(Node::pseudo, path, line, lexed);
+      return context.new_Node(Node::pseudo, file, offset(), lexed);
     }
     else {
       throw_syntax_error("unrecognized pseudo-class or pseudo-element");
@@ -453,19 +658,19 @@ namespace Sass {
   
   Node Document::parse_attribute_selector()
   {
-    Node attr_sel(context.new_Node(Node::attribute_selector, path, line, 3));
+    Node attr_sel(context.new_Node(Node::attribute_selector, file, offset(), 3));
     lex< exactly<'['> >();
     if (!lex< type_selector >()) throw_syntax_error("invalid attribute name in attribute selector");
     Token name(lexed);
-    attr_sel << context.new_Node(Node::value, path, line, name);
+    attr_sel << context.new_Node(Node::value, file, offset(), name);
     if (lex< exactly<']'> >()) return attr_sel;
     if (!lex< alternatives< exact_match, class_match, dash_match,
                             prefix_match, suffix_match, substring_match > >()) {
       throw_syntax_error("invalid operator in attribute selector for " + name.to_string());
     }
-    attr_sel << context.new_Node(Node::value, path, line, lexed);
+    attr_sel << context.new_Node(Node::value, file, offset(), lexed);
     if (!lex< string_constant >() && !lex< identifier >()) throw_syntax_error("expected a string constant or identifier in attribute selector for " + name.to_string());
-    attr_sel << context.new_Node(Node::value, path, line, lexed);
+    attr_sel << context.new_Node(Node::value, file, offset(), lexed);
     if (!lex< exactly<']'> >()) throw_syntax_error("unterminated attribute selector for " + name.to_string());
     return attr_sel;
   }
@@ -475,101 +680,118 @@ namespace Sass {
     lex< exactly<'{'> >();
     bool semicolon = false;
     Selector_Lookahead lookahead_result;
-    Node block(context.new_Node(Node::block, path, line, 0));
+    Node block(context.new_Node(Node::block, file, offset(), 0));
     while (!lex< exactly<'}'> >()) {
       if (semicolon) {
         if (!lex< exactly<';'> >()) throw_syntax_error("non-terminal statement or declaration must end with ';'");
         semicolon = false;
         while (lex< block_comment >()) {
-          block << context.new_Node(Node::comment, path, line, lexed);
+          block << context.new_Node(Node::comment, file, offset(), lexed);
         }
         if (lex< exactly<'}'> >()) break;
       }
       if (lex< block_comment >()) {
-        block << context.new_Node(Node::comment, path, line, lexed);
-      }
-      else if (peek< import >(position)) {
-        if (inside_of == Node::mixin || inside_of == Node::function) {
-          lex< import >(); // to adjust the line number
-          throw_syntax_error("@import directive not allowed inside definition of mixin or function");
-        }
-        Node imported_tree(parse_import());
-        if (imported_tree.type() == Node::css_import) {
-          block << imported_tree;
-        }
-        else {
-          for (size_t i = 0, S = imported_tree.size(); i < S; ++i) {
-            block << imported_tree[i];
-          }
-          semicolon = true;
+        block << context.new_Node(Node::comment, file, offset(), lexed);
+        continue;
+      }
+      const char* stmt = spaces_and_comments(position);
+      if (*stmt == '@') {
+        At_Rule at = at_rule(stmt);
+        switch (at) {
+          case at_import: {
+            if (inside_of == Node::mixin || inside_of == Node::function) {
+              lex< import >(); // so the error is reported at the directive
+              throw_syntax_error("@import directive not allowed inside definition of mixin or function");
+            }
+            Node imported_tree(parse_import());
+            if (imported_tree.type() == Node::css_import) {
+              block << imported_tree;
+            }
+            else {
+              for (size_t i = 0, S = imported_tree.size(); i < S; ++i) {
+                block << imported_tree[i];
+              }
+              semicolon = true;
+            }
+          } break;
+          case at_if: {
+            block << parse_if_directive(surrounding_ruleset, inside_of);
+          } break;
+          case at_for: {
+            block << parse_for_directive(surrounding_ruleset, inside_of);
+          } break;
+          case at_each: {
+            block << parse_each_directive(surrounding_ruleset, inside_of);
+          } break;
+          case at_while: {
+            block << parse_while_directive(surrounding_ruleset, inside_of);
+          } break;
+          case at_return: {
+            lex< return_directive >();
+            Node ret_expr(context.new_Node(Node::return_directive, file, offset(), 1));
+            ret_expr << parse_list();
+            block << ret_expr;
+            semicolon = true;
+          } break;
+          case at_warn: {
+            block << parse_warning();
+            semicolon = true;
+          } break;
+          default: {
+            if (inside_of == Node::function) {
+              throw_syntax_error("only variable declarations and control directives are allowed inside functions");
+            }
+            if (at == at_include) {
+              block << parse_mixin_call();
+              semicolon = true;
+            }
+            else if (at == at_extend) {
+              lex< extend >();
+              if (surrounding_ruleset.is_null_ptr()) throw_syntax_error("@extend directive may only be used within rules");
+              Node extendee(parse_simple_selector_sequence());
+              context.extensions.insert(pair<Node, Node>(extendee, surrounding_ruleset));
+              context.has_extensions = true;
+              semicolon = true;
+            }
+            else if (at == at_media) {
+              block << parse_media_query(inside_of);
+            }
+            else if (peek< directive >(stmt)) {
+              Node dir(parse_directive(surrounding_ruleset, inside_of));
+              if (dir.type() == Node::blockless_directive) semicolon = true;
+              block << dir;
+            }
+            else {
+              throw_syntax_error("invalid property name");
+            }
+          } break;
         }
       }
-      else if (lex< variable >()) {
+      else if (*stmt == '$' && lex< variable >()) {
         block << parse_assignment();
         semicolon = true;
       }
-      else if (peek< if_directive >()) {
-        block << parse_if_directive(surrounding_ruleset, inside_of);
-      }
-      else if (peek< for_directive >()) {
-        block << parse_for_directive(surrounding_ruleset, inside_of);
-      }
-      else if (peek< each_directive >()) {
-        block << parse_each_directive(surrounding_ruleset, inside_of);
-      }
-      else if (peek < while_directive >()) {
-        block << parse_while_directive(surrounding_ruleset, inside_of);
-      }
-      else if (lex < return_directive >()) {
-        Node ret_expr(context.new_Node(Node::return_directive, path, line, 1));
-        ret_expr << parse_list();
-        block << ret_expr;
-        semicolon = true;
-      }
-      else if (peek< warn >()) {
-        block << parse_warning();
-        semicolon = true;
-      }
       else if (inside_of == Node::function) {
         throw_syntax_error("only variable declarations and control directives are allowed inside functions");
       }
-      else if (peek< include >(position)) {
-        block << parse_mixin_call();
-        semicolon = true;
-      }
-      else if (peek< sequence< identifier, optional_spaces, exactly<':'>, optional_spaces, exactly<'{'> > >(position)) {
+      else if (peek< sequence< identifier, optional_spaces, exactly<':'>, optional_spaces, exactly<'{'> > >(stmt)) {
         block << parse_propset();
       }
-      else if ((lookahead_result = lookahead_for_selector(position)).found) {
+      else if ((lookahead_result = lookahead_for_selector(stmt)).found) {
         block << parse_ruleset(lookahead_result, inside_of);
       }
-      else if (peek< exactly<'+'> >()) {
+      else if (*stmt == '+') {
         block << parse_mixin_call();
         semicolon = true;
       }
-      else if (lex< extend >()) {
-        if (surrounding_ruleset.is_null_ptr()) throw_syntax_error("@extend directive may only be used within rules");
-        Node extendee(parse_simple_selector_sequence());
-        context.extensions.insert(pair<Node, Node>(extendee, surrounding_ruleset));
-        context.has_extensions = true;
-        semicolon = true;
-      }
-      else if (peek< media >()) {
-        block << parse_media_query(inside_of);
-      }
-      else if (peek< directive >()) {
-        Node dir(parse_directive(surrounding_ruleset, inside_of));
-        if (dir.type() == Node::blockless_directive) semicolon = true;
-        block << dir;
-      }
-      else if (!peek< exactly<';'> >()) {
+      else if (*stmt != ';') {
         Node rule(parse_rule());
         // check for lbrace; if it's there, we have a namespace property with a value
         if (peek< exactly<'{'> >()) {
           Node inner(parse_block(Node()));
-          Node propset(context.new_Node(Node::propset, path, line, 2));
+          Node propset(context.new_Node(Node::propset, file, offset(), 2));
           propset << rule[0];
-          rule[0] = context.new_Node(Node::property, path, line, Token::make());
+          rule[0] = context.new_Node(Node::property, file, offset(), Token::make());
           inner.push_front(rule);
           propset << inner;
           block << propset;
@@ -581,19 +803,19 @@ namespace Sass {
       }
       else lex< exactly<';'> >();
       while (lex< block_comment >()) {
-        block << context.new_Node(Node::comment, path, line, lexed);
+        block << context.new_Node(Node::comment, file, offset(), lexed);
       }
     }
     return block;
   }
 
   Node Document::parse_rule() {
-    Node rule(context.new_Node(Node::rule, path, line, 2));
+    Node rule(context.new_Node(Node::rule, file, offset(), 2));
     if (peek< sequence< optional< exactly<'*'> >, identifier_schema > >()) {
       rule << parse_identifier_schema();
     }
     else if (lex< sequence< optional< exactly<'*'> >, identifier > >()) {
-      rule << context.new_Node(Node::property, path, line, lexed);
+      rule << context.new_Node(Node::property, file, offset(), lexed);
     }
     else {
       throw_syntax_error("invalid property name");
@@ -614,12 +836,12 @@ namespace Sass {
         peek< exactly<'}'> >(position) ||
         peek< exactly<'{'> >(position) ||
         peek< exactly<')'> >(position))
-    { return context.new_Node(Node::nil, path, line, 0); }
+    { return context.new_Node(Node::nil, file, offset(), 0); }
     Node list1(parse_space_list());
     // if it's a singleton, return it directly; don't wrap it
     if (!peek< exactly<','> >(position)) return list1;
     
-    Node comma_list(context.new_Node(Node::comma_list, path, line, 2));
+    Node comma_list(context.new_Node(Node::comma_list, file, offset(), 2));
     comma_list << list1;
     comma_list.should_eval() |= list1.should_eval();
     
@@ -645,7 +867,7 @@ namespace Sass {
         peek< default_flag >(position))
     { return disj1; }
     
-    Node space_list(context.new_Node(Node::space_list, path, line, 2));
+    Node space_list(context.new_Node(Node::space_list, file, offset(), 2));
     space_list << disj1;
     space_list.should_eval() |= disj1.should_eval();
     
@@ -670,7 +892,7 @@ namespace Sass {
     // if it's a singleton, return it directly; don't wrap it
     if (!peek< sequence< or_kwd, negate< identifier > > >()) return conj1;
     
-    Node disjunction(context.new_Node(Node::disjunction, path, line, 2));
+    Node disjunction(context.new_Node(Node::disjunction, file, offset(), 2));
     disjunction << conj1;
     while (lex< sequence< or_kwd, negate< identifier > > >()) disjunction << parse_conjunction();
     disjunction.should_eval() = true;
@@ -684,7 +906,7 @@ namespace Sass {
     // if it's a singleton, return it directly; don't wrap it
     if (!peek< sequence< and_kwd, negate< identifier > > >()) return rel1;
     
-    Node conjunction(context.new_Node(Node::conjunction, path, line, 2));
+    Node conjunction(context.new_Node(Node::conjunction, file, offset(), 2));
     conjunction << rel1;
     while (lex< sequence< and_kwd, negate< identifier > > >()) conjunction << parse_relation();
     conjunction.should_eval() = true;
@@ -703,16 +925,16 @@ namespace Sass {
           peek< lte_op >(position)))
     { return expr1; }
     
-    Node relation(context.new_Node(Node::relation, path, line, 3));
+    Node relation(context.new_Node(Node::relation, file, offset(), 3));
     expr1.should_eval() = true;
     relation << expr1;
         
-    if (lex< eq_op >()) relation << context.new_Node(Node::eq, path, line, lexed);
-    else if (lex< neq_op >()) relation << context.new_Node(Node::neq, path, line, lexed);
-    else if (lex< gte_op >()) relation << context.new_Node(Node::gte, path, line, lexed);
-    else if (lex< lte_op >()) relation << context.new_Node(Node::lte, path, line, lexed);
-    else if (lex< gt_op >()) relation << context.new_Node(Node::gt, path, line, lexed);
-    else if (lex< lt_op >()) relation << context.new_Node(Node::lt, path, line, lexed);
+    if (lex< eq_op >()) relation << context.new_Node(Node::eq, file, offset(), lexed);
+    else if (lex< neq_op >()) relation << context.new_Node(Node::neq, file, offset(), lexed);
+    else if (lex< gte_op >()) relation << context.new_Node(Node::gte, file, offset(), lexed);
+    else if (lex< lte_op >()) relation << context.new_Node(Node::lte, file, offset(), lexed);
+    else if (lex< gt_op >()) relation << context.new_Node(Node::gt, file, offset(), lexed);
+    else if (lex< lt_op >()) relation << context.new_Node(Node::lt, file, offset(), lexed);
         
     Node expr2(parse_expression());
     expr2.should_eval() = true;
@@ -730,16 +952,16 @@ namespace Sass {
           peek< sequence< negate< number >, exactly<'-'> > >(position)))
     { return term1; }
     
-    Node expression(context.new_Node(Node::expression, path, line, 3));
+    Node expression(context.new_Node(Node::expression, file, offset(), 3));
     term1.should_eval() = true;
     expression << term1;
     
     while (lex< exactly<'+'> >() || lex< sequence< negate< number >, exactly<'-'> > >()) {
       if (lexed.begin[0] == '+') {
-        expression << context.new_Node(Node::add, path, line, lexed);
+        expression << context.new_Node(Node::add, file, offset(), lexed);
       }
       else {
-        expression << context.new_Node(Node::sub, path, line, lexed);
+        expression << context.new_Node(Node::sub, file, offset(), lexed);
       }
       Node term(parse_term());
       term.should_eval() = true;
@@ -758,17 +980,17 @@ namespace Sass {
           peek< exactly<'/'> >(position)))
     { return fact1; }
 
-    Node term(context.new_Node(Node::term, path, line, 3));
+    Node term(context.new_Node(Node::term, file, offset(), 3));
     term << fact1;
     if (fact1.should_eval()) term.should_eval() = true;
 
     while (lex< exactly<'*'> >() || lex< exactly<'/'> >()) {
       if (lexed.begin[0] == '*') {
-        term << context.new_Node(Node::mul, path, line, lexed);
+        term << context.new_Node(Node::mul, file, offset(), lexed);
         term.should_eval() = true;
       }
       else {
-        term << context.new_Node(Node::div, path, line, lexed);
+        term << context.new_Node(Node::div, file, offset(), lexed);
       }
       Node fact(parse_factor());
       term.should_eval() |= fact.should_eval();
@@ -790,13 +1012,13 @@ namespace Sass {
       return value;
     }
     else if (lex< sequence< exactly<'+'>, negate< number > > >()) {
-      Node plus(context.new_Node(Node::unary_plus, path, line, 1));
+      Node plus(context.new_Node(Node::unary_plus, file, offset(), 1));
       plus << parse_factor();
       plus.should_eval() = true;
       return plus;
     }
     else if (lex< sequence< exactly<'-'>, negate< number> > >()) {
-      Node minus(context.new_Node(Node::unary_minus, path, line, 1));
+      Node minus(context.new_Node(Node::unary_minus, file, offset(), 1));
       minus << parse_factor();
       minus.should_eval() = true;
       return minus;
@@ -818,7 +1040,7 @@ namespace Sass {
       	if (!rparen) throw_syntax_error("URI is missing ')'");
       	Token contents(Token::make(value, rparen));
       	// lex< string_constant >();
-      	Node result(context.new_Node(Node::uri, path, line, contents));
+      	Node result(context.new_Node(Node::uri, file, offset(), contents));
       	position = rparen;
       	lex< exactly<')'> >();
       	return result;
@@ -829,38 +1051,39 @@ namespace Sass {
     { return parse_function_call(); }
 
     if (lex< value_schema >())
-    { return Document::make_from_token(context, lexed, path, line).parse_value_schema(); }
+    { return Document::make_from_token(context, lexed, path, origin, anchor).parse_value_schema(); }
     
     if (lex< sequence< true_kwd, negate< identifier > > >())
-    { return context.new_Node(Node::boolean, path, line, true); }
+    { return context.new_Node(Node::boolean, file, offset(), true); }
     
     if (lex< sequence< false_kwd, negate< identifier > > >())
-    { return context.new_Node(Node::boolean, path, line, false); }
+    { return context.new_Node(Node::boolean, file, offset(), false); }
         
     if (lex< important >())
-    { return context.new_Node(Node::important, path, line, lexed); }
+    { return context.new_Node(Node::important, file, offset(), lexed); }
 
     if (lex< identifier >())
-    { return context.new_Node(Node::identifier, path, line, lexed); }
+    { return context.new_Node(Node::identifier, file, offset(), lexed); }
 
     if (lex< percentage >())
-    { return context.new_Node(Node::textual_percentage, path, line, lexed); }
+    { return literal(context, Node::textual_percentage, file, offset(), lexed); }
 
     if (lex< dimension >())
-    { return context.new_Node(Node::textual_dimension, path, line, lexed); }
+    { return literal(context, Node::textual_dimension, file, offset(), lexed); }
 
     if (lex< number >())
-    { return context.new_Node(Node::textual_number, path, line, lexed); }
+    { return literal(context, Node::textual_number, file, offset(), lexed); }
 
     if (lex< hex >())
-    { return context.new_Node(Node::textual_hex, path, line, lexed); }
+    { return literal(context, Node::textual_hex, file, offset(), lexed); }
 
     if (peek< string_constant >())
     { return parse_string(); } 
 
     if (lex< variable >())
     {
-      Node var(context.new_Node(Node::variable, path, line, lexed));
+      Node var(context.new_Node(Node::variable, file, offset(), lexed));
+      var.symbol() = context.symbol(lexed);
       var.should_eval() = true;
       return var;
     }
@@ -879,20 +1102,20 @@ namespace Sass {
     // see if there any interpolants
     const char* p = find_first_in_interval< sequence< negate< exactly<'\\'> >, exactly<hash_lbrace> > >(str.begin, str.end);
     if (!p) {
-      return context.new_Node(Node::string_constant, path, line, str);
+      return context.new_Node(Node::string_constant, file, offset(), str);
     }
     
-    Node schema(context.new_Node(Node::string_schema, path, line, 1));
+    Node schema(context.new_Node(Node::string_schema, file, offset(), 1));
     while (i < str.end) {
       p = find_first_in_interval< sequence< negate< exactly<'\\'> >, exactly<hash_lbrace> > >(i, str.end);
       if (p) {
         if (i < p) {
-          schema << context.new_Node(Node::identifier, path, line, Token::make(i, p)); // accumulate the preceding segment if it's nonempty
+          schema << context.new_Node(Node::identifier, file, offset(), Token::make(i, p)); // accumulate the preceding segment if it's nonempty
         }
         const char* j = find_first_in_interval< exactly<rbrace> >(p, str.end); // find the closing brace
         if (j) {
           // parse the interpolant and accumulate it
-          Node interp_node(Document::make_from_token(context, Token::make(p+2, j), path, line).parse_list());
+          Node interp_node(Document::make_from_token(context, Token::make(p+2, j), path, origin, anchor).parse_list());
           interp_node.should_eval() = true;
           schema << interp_node;
           i = j+1;
@@ -903,7 +1126,7 @@ namespace Sass {
         }
       }
       else { // no interpolants left; add the last segment if nonempty
-        if (i < str.end) schema << context.new_Node(Node::identifier, path, line, Token::make(i, str.end));
+        if (i < str.end) schema << context.new_Node(Node::identifier, file, offset(), Token::make(i, str.end));
         break;
       }
     }
@@ -913,34 +1136,36 @@ namespace Sass {
   
   Node Document::parse_value_schema()
   {    
-    Node schema(context.new_Node(Node::value_schema, path, line, 1));
+    Node schema(context.new_Node(Node::value_schema, file, offset(), 1));
     
     while (position < end) {
       if (lex< interpolant >()) {
         Token insides(Token::make(lexed.begin + 2, lexed.end - 1));
-        Node interp_node(Document::make_from_token(context, insides, path, line).parse_list());
+        Node interp_node(Document::make_from_token(context, insides, path, origin, anchor).parse_list());
         schema << interp_node;
       }
       else if (lex< identifier >()) {
-        schema << context.new_Node(Node::identifier, path, line, lexed);
+        schema << context.new_Node(Node::identifier, file, offset(), lexed);
       }
       else if (lex< percentage >()) {
-        schema << context.new_Node(Node::textual_percentage, path, line, lexed);
+        schema << literal(context, Node::textual_percentage, file, offset(), lexed);
       }
       else if (lex< dimension >()) {
-        schema << context.new_Node(Node::textual_dimension, path, line, lexed);
+        schema << literal(context, Node::textual_dimension, file, offset(), lexed);
       }
       else if (lex< number >()) {
-        schema << context.new_Node(Node::textual_number, path, line, lexed);
+        schema << literal(context, Node::textual_number, file, offset(), lexed);
       }
       else if (lex< hex >()) {
-        schema << context.new_Node(Node::textual_hex, path, line, lexed);
+        schema << literal(context, Node::textual_hex, file, offset(), lexed);
       }
       else if (lex< string_constant >()) {
-        schema << context.new_Node(Node::string_constant, path, line, lexed);
+        schema << context.new_Node(Node::string_constant, file, offset(), lexed);
       }
       else if (lex< variable >()) {
-        schema << context.new_Node(Node::variable, path, line, lexed);
+        Node var(context.new_Node(Node::variable, file, offset(), lexed));
+        var.symbol() = context.symbol(lexed);
+        schema << var;
       }
       else {
         throw_syntax_error("error parsing interpolated value");
@@ -958,20 +1183,20 @@ namespace Sass {
     // see if there any interpolants
     const char* p = find_first_in_interval< sequence< negate< exactly<'\\'> >, exactly<hash_lbrace> > >(id.begin, id.end);
     if (!p) {
-      return context.new_Node(Node::string_constant, path, line, id);
+      return context.new_Node(Node::string_constant, file, offset(), id);
     }
     
-    Node schema(context.new_Node(Node::identifier_schema, path, line, 1));
+    Node schema(context.new_Node(Node::identifier_schema, file, offset(), 1));
     while (i < id.end) {
       p = find_first_in_interval< sequence< negate< exactly<'\\'> >, exactly<hash_lbrace> > >(i, id.end);
       if (p) {
         if (i < p) {
-          schema << context.new_Node(Node::identifier, path, line, Token::make(i, p)); // accumulate the preceding segment if it's nonempty
+          schema << context.new_Node(Node::identifier, file, offset(), Token::make(i, p)); // accumulate the preceding segment if it's nonempty
         }
         const char* j = find_first_in_interval< exactly<rbrace> >(p, id.end); // find the closing brace
         if (j) {
           // parse the interpolant and accumulate it
-          Node interp_node(Document::make_from_token(context, Token::make(p+2, j), path, line).parse_list());
+          Node interp_node(Document::make_from_token(context, Token::make(p+2, j), path, origin, anchor).parse_list());
           interp_node.should_eval() = true;
           schema << interp_node;
           i = j+1;
@@ -982,7 +1207,7 @@ namespace Sass {
         }
       }
       else { // no interpolants left; add the last segment if nonempty
-        if (i < id.end) schema << context.new_Node(Node::identifier, path, line, Token::make(i, id.end));
+        if (i < id.end) schema << context.new_Node(Node::identifier, file, offset(), Token::make(i, id.end));
         break;
       }
     }
@@ -998,11 +1223,12 @@ namespace Sass {
     }
     else {
       lex< identifier >();
-      name = context.new_Node(Node::identifier, path, line, lexed);
+      name = context.new_Node(Node::identifier, file, offset(), lexed);
+      name.symbol() = context.symbol(lexed);
     }
 
     Node args(parse_arguments());
-    Node call(context.new_Node(Node::function_call, path, line, 2));
+    Node call(context.new_Node(Node::function_call, file, offset(), 2));
     call << name << args;
     call.should_eval() = true;
     return call;
@@ -1011,7 +1237,7 @@ namespace Sass {
   Node Document::parse_if_directive(Node surrounding_ruleset, Node::Type inside_of)
   {
     lex< if_directive >();
-    Node conditional(context.new_Node(Node::if_directive, path, line, 2));
+    Node conditional(context.new_Node(Node::if_directive, file, offset(), 2));
     conditional << parse_list(); // the predicate
     if (!lex< exactly<'{'> >()) throw_syntax_error("expected '{' after the predicate for @if");
     conditional << parse_block(surrounding_ruleset, inside_of); // the consequent
@@ -1032,9 +1258,10 @@ namespace Sass {
   Node Document::parse_for_directive(Node surrounding_ruleset, Node::Type inside_of)
   {
     lex< for_directive >();
-    size_t for_line = line;
+    size_t for_offset = offset();
     if (!lex< variable >()) throw_syntax_error("@for directive requires an iteration variable");
-    Node var(context.new_Node(Node::variable, path, line, lexed));
+    Node var(context.new_Node(Node::variable, file, offset(), lexed));
+    var.symbol() = context.symbol(lexed);
     if (!lex< from >()) throw_syntax_error("expected 'from' keyword in @for directive");
     Node lower_bound(parse_expression());
     Node::Type for_type = Node::for_through_directive;
@@ -1044,7 +1271,7 @@ namespace Sass {
     Node upper_bound(parse_expression());
     if (!peek< exactly<'{'> >()) throw_syntax_error("expected '{' after the upper bound in @for directive");
     Node body(parse_block(surrounding_ruleset, inside_of));
-    Node loop(context.new_Node(for_type, path, for_line, 4));
+    Node loop(context.new_Node(for_type, file, for_offset, 4));
     loop << var << lower_bound << upper_bound << body;
     return loop;
   }
@@ -1052,14 +1279,15 @@ namespace Sass {
   Node Document::parse_each_directive(Node surrounding_ruleset, Node::Type inside_of)
   {
     lex < each_directive >();
-    size_t each_line = line;
+    size_t each_offset = offset();
     if (!lex< variable >()) throw_syntax_error("@each directive requires an iteration variable");
-    Node var(context.new_Node(Node::variable, path, line, lexed));
+    Node var(context.new_Node(Node::variable, file, offset(), lexed));
+    var.symbol() = context.symbol(lexed);
     if (!lex< in >()) throw_syntax_error("expected 'in' keyword in @each directive");
     Node list(parse_list());
     if (!peek< exactly<'{'> >()) throw_syntax_error("expected '{' after the upper bound in @each directive");
     Node body(parse_block(surrounding_ruleset, inside_of));
-    Node each(context.new_Node(Node::each_directive, path, each_line, 3));
+    Node each(context.new_Node(Node::each_directive, file, each_offset, 3));
     each << var << list << body;
     return each;
   }
@@ -1067,10 +1295,10 @@ namespace Sass {
   Node Document::parse_while_directive(Node surrounding_ruleset, Node::Type inside_of)
   {
     lex< while_directive >();
-    size_t while_line = line;
+    size_t while_offset = offset();
     Node predicate(parse_list());
     Node body(parse_block(surrounding_ruleset, inside_of));
-    Node loop(context.new_Node(Node::while_directive, path, while_line, 2));
+    Node loop(context.new_Node(Node::while_directive, file, while_offset, 2));
     loop << predicate << body;
     return loop;
   }
@@ -1078,10 +1306,10 @@ namespace Sass {
   Node Document::parse_directive(Node surrounding_ruleset, Node::Type inside_of)
   {
     lex< directive >();
-    Node dir_name(context.new_Node(Node::blockless_directive, path, line, lexed));
+    Node dir_name(context.new_Node(Node::blockless_directive, file, offset(), lexed));
     if (!peek< exactly<'{'> >()) return dir_name;
     Node block(parse_block(surrounding_ruleset, inside_of));
-    Node dir(context.new_Node(Node::block_directive, path, line, 2));
+    Node dir(context.new_Node(Node::block_directive, file, offset(), 2));
     dir << dir_name << block;
     return dir;
   }
@@ -1089,13 +1317,13 @@ namespace Sass {
   Node Document::parse_media_query(Node::Type inside_of)
   {
     lex< media >();
-    Node media_query(context.new_Node(Node::media_query, path, line, 2));
+    Node media_query(context.new_Node(Node::media_query, file, offset(), 2));
     Node media_expr(parse_media_expression());
     if (peek< exactly<'{'> >()) {
       media_query << media_expr;
     }
     else if (peek< exactly<','> >()) {
-      Node media_expr_group(context.new_Node(Node::media_expression_group, path, line, 2));
+      Node media_expr_group(context.new_Node(Node::media_expression_group, file, offset(), 2));
       media_expr_group << media_expr;
       while (lex< exactly<','> >()) {
         media_expr_group << parse_media_expression();
@@ -1113,16 +1341,16 @@ namespace Sass {
   extern const char only_kwd[] = "only";
   Node Document::parse_media_expression()
   {
-    Node media_expr(context.new_Node(Node::media_expression, path, line, 1));
+    Node media_expr(context.new_Node(Node::media_expression, file, offset(), 1));
     // if the query begins with 'not' or 'only', then a media type is required
     if (lex< not_kwd >() || lex< exactly<only_kwd> >()) {
-      media_expr << context.new_Node(Node::identifier, path, line, lexed);
+      media_expr << context.new_Node(Node::identifier, file, offset(), lexed);
       if (!lex< identifier >()) throw_syntax_error("media type expected in media query");
-      media_expr << context.new_Node(Node::identifier, path, line, lexed);
+      media_expr << context.new_Node(Node::identifier, file, offset(), lexed);
     }
     // otherwise, the media type is optional
     else if (lex< identifier >()) {
-      media_expr << context.new_Node(Node::identifier, path, line, lexed);
+      media_expr << context.new_Node(Node::identifier, file, offset(), lexed);
     }
     // if no media type was present, then require a parenthesized property
     if (media_expr.empty()) {
@@ -1133,7 +1361,7 @@ namespace Sass {
     // parse the rest of the properties for this disjunct
     while (!peek< exactly<','> >() && !peek< exactly<'{'> >()) {
       if (!lex< and_kwd >()) throw_syntax_error("invalid media query");
-      media_expr << context.new_Node(Node::identifier, path, line, lexed);
+      media_expr << context.new_Node(Node::identifier, file, offset(), lexed);
       if (!lex< exactly<'('> >()) throw_syntax_error("invalid media query");
       media_expr << parse_rule();
       if (!lex< exactly<')'> >()) throw_syntax_error("unclosed parenthesis");
@@ -1144,51 +1372,94 @@ namespace Sass {
   Node Document::parse_warning()
   {
     lex< warn >();
-    Node warning(context.new_Node(Node::warning, path, line, 1));
+    Node warning(context.new_Node(Node::warning, file, offset(), 1));
     warning << parse_list();
     warning[0].should_eval() = true;
     return warning;
   }
  
+  // Classifies a statement by scanning the selector it would start with. The
+  // comments and whitespace in front of each token are skipped once, and the
+  // token's first character picks the matchers that could possibly apply;
+  // within each case they're tried in the order the selector grammar lists
+  // them, so the scan accepts exactly what a chain of peeks would. The tokens
+  // are kept, so that parse_ruleset doesn't have to lex them all over again.
   Selector_Lookahead Document::lookahead_for_selector(const char* start)
   {
     const char* p = start ? start : position;
     const char* q;
     bool saw_interpolant = false;
+    scan_text(source, end);
+    selector_tokens.clear();
 
-    while ((q = peek< identifier >(p))                             ||
-           (q = peek< id_name >(p))                                ||
-           (q = peek< class_name >(p))                             ||
-           (q = peek< sequence< pseudo_prefix, identifier > >(p))  ||
-           (q = peek< string_constant >(p))                        ||
-           (q = peek< exactly<'*'> >(p))                           ||
-           (q = peek< exactly<'('> >(p))                           ||
-           (q = peek< exactly<')'> >(p))                           ||
-           (q = peek< exactly<'['> >(p))                           ||
-           (q = peek< exactly<']'> >(p))                           ||
-           (q = peek< exactly<'+'> >(p))                           ||
-           (q = peek< exactly<'~'> >(p))                           ||
-           (q = peek< exactly<'>'> >(p))                           ||
-           (q = peek< exactly<','> >(p))                           ||
-           (q = peek< binomial >(p))                               ||
-           (q = peek< sequence< optional<sign>,
-                                optional<digits>,
-                                exactly<'n'> > >(p))               ||
-           (q = peek< sequence< optional<sign>,
-                                digits > >(p))                     ||
-           (q = peek< number >(p))                                 ||
-           (q = peek< exactly<'&'> >(p))                           ||
-           (q = peek< alternatives<exact_match,
-                                   class_match,
-                                   dash_match,
-                                   prefix_match,
-                                   suffix_match,
-                                   substring_match> >(p))          ||
-           (q = peek< sequence< exactly<'.'>, interpolant > >(p))  ||
-           (q = peek< sequence< exactly<'#'>, interpolant > >(p))  ||
-           (q = peek< sequence< exactly<'-'>, interpolant > >(p))  ||
-           (q = peek< sequence< pseudo_prefix, interpolant > >(p)) ||
-           (q = peek< interpolant >(p))) {
+    for (;;) {
+      const char* t = spaces_and_comments(p);
+      Selector_Token::Kind kind = Selector_Token::other;
+      switch (*t) {
+        case '#':
+          if ((q = id_name(t))) kind = Selector_Token::simple;
+          else (q = sequence< exactly<'#'>, interpolant >(t)) ||
+               (q = interpolant(t));
+          break;
+        case '.':
+          if ((q = class_name(t))) kind = Selector_Token::simple;
+          else (q = number(t)) ||
+               (q = sequence< exactly<'.'>, interpolant >(t));
+          break;
+        case ':':
+          if ((q = sequence< pseudo_prefix, identifier >(t))) kind = Selector_Token::pseudo;
+          else q = sequence< pseudo_prefix, interpolant >(t);
+          break;
+        case '"': case '\'':
+          q = string_constant(t);
+          break;
+        case '*':
+          q = t + 1;
+          kind = Selector_Token::universal;
+          break;
+        case '&':
+          q = t + 1;
+          kind = Selector_Token::backref;
+          break;
+        case '+': case '~': case '>':
+          q = t + 1;
+          kind = Selector_Token::combinator;
+          break;
+        case ',':
+          q = t + 1;
+          kind = Selector_Token::comma;
+          break;
+        case '(': case ')': case '[': case ']':
+          q = t + 1;
+          break;
+        case '-':
+          if ((q = identifier(t))) kind = Selector_Token::type;
+          else (q = binomial(t)) ||
+               (q = sequence< optional<sign>, optional<digits>, exactly<'n'> >(t)) ||
+               (q = sequence< optional<sign>, digits >(t)) ||
+               (q = number(t)) ||
+               (q = sequence< exactly<'-'>, interpolant >(t));
+          break;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+          (q = binomial(t)) ||
+          (q = sequence< optional<digits>, exactly<'n'> >(t)) ||
+          (q = digits(t));
+          break;
+        case '=': case '|': case '^': case '$':
+          q = alternatives< exact_match,
+                            dash_match,
+                            prefix_match,
+                            suffix_match >(t);
+          break;
+        default:
+          q = identifier(t);
+          kind = Selector_Token::type;
+          break;
+      }
+      if (!q) break;
+      Selector_Token token = { t, q, t != p && spaces(p), kind };
+      selector_tokens.push_back(token);
       p = q;
       if (*(p - 1) == '}') saw_interpolant = true;
     }
@@ -1196,6 +1467,8 @@ namespace Sass {
     Selector_Lookahead result;
     result.found            = peek< exactly<'{'> >(p) ? p : 0;
     result.has_interpolants = saw_interpolant;
+    result.tokens           = selector_tokens.empty() ? 0 : &selector_tokens[0];
+    result.token_count      = selector_tokens.size();
 
     return result;
   }
@@ -4,12 +4,12 @@ namespace Sass {
     enum Type { read, write, syntax, evaluation };
     
     Type type;
-    string path;
-    size_t line;
+    size_t file;
+    size_t offset; // where in file it happened
     string message;
     
-    Error(Type type, string path, size_t line, string message)
-    : type(type), path(path), line(line), message(message)
+    Error(Type type, size_t file, size_t offset, string message)
+    : type(type), file(file), offset(offset), message(message)
     { }
 
   };
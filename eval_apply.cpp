@@ -5,40 +5,1026 @@
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
+#include <algorithm>
 
 namespace Sass {
   using std::cerr; using std::endl;
 
-  static void throw_eval_error(string message, string path, size_t line)
+  static void throw_eval_error(string message, size_t file, size_t offset)
+  { throw Error(Error::evaluation, file, offset, message); }
+
+  // Canonical values (Node_Factory::boolean, nil, number) have no position,
+  // so errors raised on them are reported where they were being used.
+  static void locate_error(Error& e, Node n)
+  {
+    if (!e.file && !e.offset) {
+      e.file = n.file();
+      e.offset = n.offset();
+    }
+  }
+
+  // Mixin, function, and loop bodies are frozen (see Node::freeze) and shared
+  // by every expansion instead of being cloned up front. Eval copies a shared
+  // node only when it's about to change it; the (possibly new) node is
+  // returned as usual and the parent stores it with set_child, which copies
+  // the parent in turn if need be.
+
+  static Node writable(Node n, Node_Factory& new_Node)
+  { return n.is_shared() ? new_Node.shallow_copy(n) : n; }
+
+  static void set_child(Node& parent, size_t i, Node child, Node_Factory& new_Node)
+  {
+    if (parent[i].is(child)) return;
+    parent = writable(parent, new_Node);
+    parent[i] = child;
+  }
+
+  static bool contains_loop(Node n)
+  {
+    switch (n.type())
+    {
+      case Node::for_through_directive:
+      case Node::for_to_directive:
+      case Node::each_directive:
+      case Node::while_directive:
+        return true;
+      default:
+        break;
+    }
+    for (size_t i = 0, S = n.size(); i < S; ++i) {
+      if (contains_loop(n[i])) return true;
+    }
+    return false;
+  }
+
+  // Resolve every name to a slot in the scope it's evaluated in, so that
+  // environments can be flat arrays instead of maps. Scopes mirror the frames
+  // eval creates: one per block, one per mixin and function body (linked to
+  // the global scope), and one per loop body (linked to the scope the loop
+  // is in). Inside functions, @if blocks run in the function's own frame.
+
+  static size_t new_scope(size_t parent, Context& ctx)
+  {
+    ctx.scopes.push_back(Scope(parent));
+    return ctx.scopes.size() - 1;
+  }
+
+  static void declare(Node var, size_t scope, Context& ctx)
+  {
+    size_t k = ctx.scopes[scope].slot(var.symbol());
+    ctx.scopes[scope].binds[k] = true;
+    var.set_slot(k);
+  }
+
+  static void resolve_names(Node expr, size_t scope, bool in_function, Context& ctx);
+
+  static void resolve_children(Node expr, size_t scope, bool in_function, Context& ctx)
+  {
+    for (size_t i = 0, S = expr.size(); i < S; ++i) resolve_names(expr[i], scope, in_function, ctx);
+  }
+
+  // Default arguments are evaluated in the caller's environment, so they're
+  // left unresolved and get looked up by symbol.
+  static void resolve_parameters(Node params, size_t scope, Context& ctx)
+  {
+    for (size_t i = 0, S = params.size(); i < S; ++i) {
+      declare(params[i].type() == Node::assignment ? params[i][0] : params[i], scope, ctx);
+    }
+  }
+
+  // keyword arguments name the callee's parameters, not anything in scope
+  static void resolve_arguments(Node args, size_t scope, bool in_function, Context& ctx)
+  {
+    for (size_t i = 0, S = args.size(); i < S; ++i) {
+      if (args[i].type() == Node::assignment) resolve_names(args[i][1], scope, in_function, ctx);
+      else                                    resolve_names(args[i], scope, in_function, ctx);
+    }
+  }
+
+  static void resolve_names(Node expr, size_t scope, bool in_function, Context& ctx)
+  {
+    switch (expr.type())
+    {
+      case Node::variable: {
+        expr.set_slot(ctx.scopes[scope].slot(expr.symbol()));
+      } break;
+
+      case Node::assignment: {
+        declare(expr[0], scope, ctx);
+        resolve_names(expr[1], scope, in_function, ctx);
+      } break;
+
+      // mixins are always bound in the global frame
+      case Node::mixin: {
+        expr[0].set_slot(ctx.scopes[0].slot(expr[0].symbol()));
+        size_t body_scope = new_scope(0, ctx);
+        expr.set_slot(body_scope);
+        resolve_parameters(expr[1], body_scope, ctx);
+        resolve_children(expr[2], body_scope, false, ctx);
+      } break;
+
+      case Node::function: {
+        size_t body_scope = new_scope(0, ctx);
+        expr.set_slot(body_scope);
+        resolve_parameters(expr[1], body_scope, ctx);
+        resolve_children(expr[2], body_scope, true, ctx);
+      } break;
+
+      case Node::expansion: {
+        expr[0].set_slot(ctx.scopes[0].slot(expr[0].symbol()));
+        resolve_arguments(expr[1], scope, in_function, ctx);
+      } break;
+
+      case Node::function_call: {
+        resolve_names(expr[0], scope, in_function, ctx);
+        resolve_arguments(expr[1], scope, in_function, ctx);
+      } break;
+
+      case Node::block: {
+        if (in_function) {
+          resolve_children(expr, scope, in_function, ctx);
+        }
+        else {
+          size_t block_scope = new_scope(scope, ctx);
+          expr.set_slot(block_scope);
+          resolve_children(expr, block_scope, in_function, ctx);
+        }
+      } break;
+
+      case Node::for_through_directive:
+      case Node::for_to_directive: {
+        resolve_names(expr[1], scope, in_function, ctx);
+        resolve_names(expr[2], scope, in_function, ctx);
+        size_t body_scope = new_scope(scope, ctx);
+        expr.set_slot(body_scope);
+        declare(expr[0], body_scope, ctx);
+        resolve_children(expr[3], body_scope, in_function, ctx);
+      } break;
+
+      case Node::each_directive: {
+        resolve_names(expr[1], scope, in_function, ctx);
+        size_t body_scope = new_scope(scope, ctx);
+        expr.set_slot(body_scope);
+        declare(expr[0], body_scope, ctx);
+        resolve_children(expr[2], body_scope, in_function, ctx);
+      } break;
+
+      case Node::while_directive: {
+        resolve_names(expr[0], scope, in_function, ctx);
+        size_t body_scope = new_scope(scope, ctx);
+        expr.set_slot(body_scope);
+        resolve_children(expr[1], body_scope, in_function, ctx);
+      } break;
+
+      default: {
+        resolve_children(expr, scope, in_function, ctx);
+      } break;
+    }
+  }
+
+  void resolve(Node root, Context& ctx)
+  {
+    resolve_names(root, 0, false, ctx);
+    // link each slot to the nearest enclosing scope that can bind the same name
+    for (size_t i = 1, S = ctx.scopes.size(); i < S; ++i) {
+      Scope& scope = ctx.scopes[i];
+      scope.outer.resize(scope.symbols.size());
+      for (size_t k = 0, L = scope.symbols.size(); k < L; ++k) {
+        Scope::Link link = { 0, 0 };
+        size_t depth = 0;
+        size_t up = i;
+        do {
+          up = ctx.scopes[up].parent;
+          ++depth;
+          map<size_t, size_t>::iterator it = ctx.scopes[up].slots.find(scope.symbols[k]);
+          if (it != ctx.scopes[up].slots.end() && ctx.scopes[up].binds[it->second]) {
+            link.depth = depth;
+            link.slot  = it->second;
+            break;
+          }
+        } while (up);
+        scope.outer[k] = link;
+      }
+    }
+    ctx.scopes[0].outer.resize(ctx.scopes[0].symbols.size());
+    ctx.global_env.enter(ctx.scopes[0]);
+  }
+
+  // Drop the top-level definitions and assignments that nothing uses, so
+  // that a framework pulled in with @import only costs as much as is used
+  // of it. Every other top-level statement is live. A mixin or function
+  // becomes live when something live includes or calls it by name (all
+  // functions do, if any call's name is interpolated), and an assignment
+  // when something live reads its variable. Names aren't told apart by
+  // scope, so a local that shadows a global keeps the global alive.
+  // Assignments that call anything but builtins are always kept, since user
+  // functions can have effects, and so are assignments that read variables
+  // no top-level assignment above them binds, so that the error is still
+  // reported. What's dropped goes in Context::pruned.
+
+  struct Liveness {
+    Context& ctx;
+    vector<bool> mixins, functions, variables; // by symbol
+    vector<bool> assigned;                     // by symbol, so far
+    bool any_function;
+    map<size_t, vector<Node> > mixin_defs, function_defs, assignments;
+    vector<Node> pending;
+
+    Liveness(Context& ctx)
+    : ctx(ctx),
+      mixins(vector<bool>(ctx.symbol_names.size())),
+      functions(vector<bool>(ctx.symbol_names.size())),
+      variables(vector<bool>(ctx.symbol_names.size())),
+      assigned(vector<bool>(ctx.symbol_names.size())),
+      any_function(false),
+      mixin_defs(map<size_t, vector<Node> >()),
+      function_defs(map<size_t, vector<Node> >()),
+      assignments(map<size_t, vector<Node> >()),
+      pending(vector<Node>())
+    { }
+
+    void mark(vector<bool>& used, size_t symbol, map<size_t, vector<Node> >& defs)
+    {
+      if (used[symbol]) return;
+      used[symbol] = true;
+      map<size_t, vector<Node> >::iterator it = defs.find(symbol);
+      if (it != defs.end()) pending.insert(pending.end(), it->second.begin(), it->second.end());
+    }
+
+    void mark_all_functions()
+    {
+      if (any_function) return;
+      any_function = true;
+      for (map<size_t, vector<Node> >::iterator it = function_defs.begin(); it != function_defs.end(); ++it) {
+        mark(functions, it->first, function_defs);
+      }
+    }
+
+    void visit(Node expr)
+    {
+      switch (expr.type())
+      {
+        case Node::variable: {
+          mark(variables, expr.symbol(), assignments);
+        } break;
+
+        case Node::expansion: {
+          mark(mixins, expr[0].symbol(), mixin_defs);
+          visit(expr[1]);
+        } break;
+
+        case Node::function_call: {
+          Node name(expr[0]);
+          if (name.type() == Node::identifier && name.symbol()) mark(functions, name.symbol(), function_defs);
+          else {
+            mark_all_functions();
+            visit(name);
+          }
+          visit(expr[1]);
+        } break;
+
+        // only what's assigned is read, and only default values of parameters
+        case Node::assignment: {
+          for (size_t i = 1, S = expr.size(); i < S; ++i) visit(expr[i]);
+        } break;
+
+        case Node::parameters: {
+          for (size_t i = 0, S = expr.size(); i < S; ++i) {
+            if (expr[i].type() == Node::assignment) visit(expr[i][1]);
+          }
+        } break;
+
+        default: {
+          for (size_t i = 0, S = expr.size(); i < S; ++i) visit(expr[i]);
+        } break;
+      }
+    }
+
+    // whether evaluating expr only calls builtins
+    bool calls_only_builtins(Node expr)
+    {
+      if (expr.type() == Node::function_call) {
+        Node name(expr[0]);
+        if (name.type() != Node::identifier || !name.symbol() || function_defs.count(name.symbol())) return false;
+        map<pair<size_t, size_t>, Function>::iterator def = ctx.function_env.lower_bound(pair<size_t, size_t>(name.symbol(), 0));
+        if (def == ctx.function_env.end() || def->first.first != name.symbol()) return false;
+      }
+      for (size_t i = 0, S = expr.size(); i < S; ++i) {
+        if (!calls_only_builtins(expr[i])) return false;
+      }
+      return true;
+    }
+
+    // whether every variable expr reads has been assigned already
+    bool reads_only_assigned(Node expr)
+    {
+      if (expr.type() == Node::variable) return assigned[expr.symbol()];
+      for (size_t i = 0, S = expr.size(); i < S; ++i) {
+        if (!reads_only_assigned(expr[i])) return false;
+      }
+      return true;
+    }
+  };
+
+  void prune(Node root, Context& ctx)
+  {
+    Liveness live(ctx);
+    for (size_t i = 0, S = root.size(); i < S; ++i) {
+      Node stm(root[i]);
+      if      (stm.type() == Node::mixin)    live.mixin_defs[stm[0].symbol()].push_back(stm);
+      else if (stm.type() == Node::function) live.function_defs[stm[0].symbol()].push_back(stm);
+    }
+    vector<bool> prunable(root.size());
+    for (size_t i = 0, S = root.size(); i < S; ++i) {
+      Node stm(root[i]);
+      switch (stm.type())
+      {
+        case Node::mixin:
+        case Node::function: {
+          prunable[i] = true;
+        } break;
+
+        case Node::assignment: {
+          prunable[i] = live.calls_only_builtins(stm[1]) && live.reads_only_assigned(stm[1]);
+          if (prunable[i]) live.assignments[stm[0].symbol()].push_back(stm);
+          else             live.pending.push_back(stm);
+          live.assigned[stm[0].symbol()] = true;
+        } break;
+
+        default: {
+          live.pending.push_back(stm);
+        } break;
+      }
+    }
+    while (!live.pending.empty()) {
+      Node stm(live.pending.back());
+      live.pending.pop_back();
+      live.visit(stm);
+    }
+
+    vector<Node> kept;
+    for (size_t i = 0, S = root.size(); i < S; ++i) {
+      Node stm(root[i]);
+      bool used = true;
+      if (prunable[i]) {
+        switch (stm.type())
+        {
+          case Node::mixin:    used = live.mixins[stm[0].symbol()];    break;
+          case Node::function: used = live.functions[stm[0].symbol()]; break;
+          default:             used = live.variables[stm[0].symbol()]; break;
+        }
+      }
+      if (used) kept.push_back(stm);
+      else      ctx.pruned.push_back(stm);
+    }
+    if (kept.size() == root.size()) return;
+    while (!root.empty()) root.pop_back();
+    for (size_t i = 0, S = kept.size(); i < S; ++i) root << kept[i];
+  }
+
+  // Fold arithmetic on literals (e.g. 960px / 12 or #fff - #111) into its
+  // value up front, so that bodies that are expanded over and over don't
+  // redo it. The folding is done by eval itself, and only where eval would
+  // evaluate the subtree anyway: rules, assignments and @each evaluate every
+  // item of their lists, but lists nested in anything else only get their
+  // first item evaluated. Terms that aren't evaluated (like the 10px/2px in a
+  // property) are slashes rather than divisions, so they're left alone.
+
+  static bool is_literal(Node expr)
+  {
+    switch (expr.type())
+    {
+      case Node::textual_number:
+      case Node::textual_dimension:
+      case Node::textual_percentage:
+      case Node::textual_hex:
+      case Node::number:
+      case Node::numeric_dimension:
+      case Node::numeric_percentage:
+      case Node::numeric_color:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  static bool is_foldable(Node expr)
+  {
+    switch (expr.type())
+    {
+      case Node::unary_plus:
+      case Node::unary_minus:
+        return is_literal(expr[0]);
+      case Node::term:
+        if (!expr.should_eval()) return false;
+        // fall through
+      case Node::expression:
+        for (size_t i = 0, S = expr.size(); i < S; i += 2) {
+          if (!is_literal(expr[i])) return false;
+        }
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  static Node fold_constants(Node expr, bool evaluated, bool every_item, Context& ctx)
+  {
+    switch (expr.type())
+    {
+      case Node::comma_list:
+      case Node::space_list: {
+        for (size_t i = 0, S = expr.size(); i < S; ++i) {
+          expr[i] = fold_constants(expr[i], evaluated && (every_item || i == 0), false, ctx);
+        }
+        return expr;
+      } break;
+
+      case Node::rule:
+      case Node::assignment: {
+        expr[0] = fold_constants(expr[0], evaluated, false, ctx);
+        expr[1] = fold_constants(expr[1], evaluated, true, ctx);
+        return expr;
+      } break;
+
+      case Node::each_directive: {
+        expr[1] = fold_constants(expr[1], evaluated, true, ctx);
+        expr[2] = fold_constants(expr[2], evaluated, false, ctx);
+        return expr;
+      } break;
+
+      default: {
+        for (size_t i = 0, S = expr.size(); i < S; ++i) {
+          expr[i] = fold_constants(expr[i], evaluated, false, ctx);
+        }
+        if (!evaluated || !is_foldable(expr)) return expr;
+        try {
+          Node value(eval(expr, Node(), ctx.global_env, ctx.function_env, ctx.new_Node, ctx));
+          switch (value.type())
+          {
+            case Node::number:
+            case Node::numeric_dimension:
+            case Node::numeric_color:
+              return value;
+            default:
+              return expr;
+          }
+        }
+        catch (Error&) {
+          // leave it to fail if and when it's actually evaluated
+          return expr;
+        }
+      } break;
+    }
+    return expr;
+  }
+
+  void fold(Node root, Context& ctx)
+  {
+    fold_constants(root, true, false, ctx);
+  }
+
+  // Compile arithmetic and logical expressions into programs (see
+  // bytecode.hpp). Only the outermost expression of a nest gets a program;
+  // its id goes in the slot field. Operands that aren't numbers, dimensions
+  // or variables are evaluated by eval as usual; they (and unary operators,
+  // which eval may fill in) are found by their path from the root rather
+  // than kept, since function bodies with loops are cloned on each call and
+  // eval may change them in place.
+
+  static bool is_compilable(Node expr)
+  {
+    switch (expr.type())
+    {
+      case Node::disjunction:
+      case Node::conjunction:
+      case Node::relation:
+      case Node::expression:
+        return true;
+      case Node::term:
+        return expr.should_eval();
+      default:
+        return false;
+    }
+  }
+
+  static size_t constant(Program& prog, Node n, double number = 0, Token unit = Token::make())
+  {
+    Constant c = { n, number, unit, vector<size_t>() };
+    prog.constants.push_back(c);
+    return prog.constants.size() - 1;
+  }
+
+  static void emit(Program& prog, Instruction::Opcode code, Node::Type op, size_t dst, size_t lhs, size_t rhs, size_t k)
+  {
+    Instruction i = { code, op, static_cast<unsigned char>(dst), static_cast<unsigned char>(lhs), static_cast<unsigned char>(rhs), k };
+    prog.code.push_back(i);
+  }
+
+  void compile(Node expr, Context& ctx);
+
+  // Emits code leaving the value of expr in register dst. Returns false if
+  // it needs more registers than there are.
+  static bool compile_operand(Node expr, size_t dst, vector<size_t>& path, Program& prog, Context& ctx)
+  {
+    if (dst >= Program::max_registers) return false;
+    if (dst >= prog.registers) prog.registers = dst + 1;
+    switch (expr.type())
+    {
+      case Node::disjunction:
+      case Node::conjunction: {
+        Instruction::Opcode jump = expr.type() == Node::disjunction ? Instruction::jump_unless_false
+                                                                    : Instruction::jump_if_false;
+        vector<size_t> exits;
+        for (size_t i = 0, S = expr.size(); i < S; ++i) {
+          path.push_back(i);
+          if (!compile_operand(expr[i], dst, path, prog, ctx)) return false;
+          path.pop_back();
+          if (i + 1 < S) {
+            exits.push_back(prog.code.size());
+            emit(prog, jump, Node::none, dst, dst, 0, 0);
+          }
+        }
+        for (size_t i = 0, S = exits.size(); i < S; ++i) prog.code[exits[i]].k = prog.code.size();
+      } break;
+
+      case Node::relation: {
+        path.push_back(0);
+        if (!compile_operand(expr[0], dst, path, prog, ctx)) return false;
+        path.back() = 2;
+        if (!compile_operand(expr[2], dst+1, path, prog, ctx)) return false;
+        path.pop_back();
+        emit(prog, Instruction::compare, expr[1].type(), dst, dst, dst+1, constant(prog, expr));
+      } break;
+
+      case Node::term:
+        if (!expr.should_eval()) goto leaf;
+        // fall through
+      case Node::expression: {
+        size_t where = constant(prog, expr);
+        path.push_back(0);
+        if (!compile_operand(expr[0], dst, path, prog, ctx)) return false;
+        for (size_t i = 1, S = expr.size(); i < S; i += 2) {
+          path.back() = i+1;
+          if (!compile_operand(expr[i+1], dst+1, path, prog, ctx)) return false;
+          emit(prog, Instruction::arithmetic, expr[i].type(), dst, dst, dst+1, where);
+        }
+        path.pop_back();
+      } break;
+
+      case Node::unary_plus:
+      case Node::unary_minus: {
+        size_t k = constant(prog, expr);
+        prog.constants[k].path = path;
+        path.push_back(0);
+        if (!compile_operand(expr[0], dst, path, prog, ctx)) return false;
+        path.pop_back();
+        if (expr.type() == Node::unary_plus) emit(prog, Instruction::affirm, Node::none, dst, dst, 0, k);
+        else emit(prog, Instruction::negate, Node::none, dst, dst, 0, k);
+      } break;
+
+      case Node::textual_number: {
+        size_t k = constant(prog, expr, expr.numeric_value());
+        emit(prog, Instruction::load_number, Node::none, dst, 0, 0, k);
+      } break;
+
+      case Node::textual_dimension: {
+        size_t k = constant(prog, expr, expr.numeric_value(),
+                            Token::make(Prelexer::number(expr.token().begin), expr.token().end));
+        emit(prog, Instruction::load_dimension, Node::none, dst, 0, 0, k);
+      } break;
+
+      case Node::variable: {
+        emit(prog, Instruction::load_variable, Node::none, dst, 0, 0, constant(prog, expr));
+      } break;
+
+      default:
+      leaf: {
+        size_t k = constant(prog, expr);
+        prog.constants[k].path = path;
+        emit(prog, Instruction::evaluate, Node::none, dst, 0, 0, k);
+        // look for expressions in function arguments and the like
+        for (size_t i = 0, S = expr.size(); i < S; ++i) compile(expr[i], ctx);
+      } break;
+    }
+    return true;
+  }
+
+  void compile(Node expr, Context& ctx)
+  {
+    if (expr.is_null_ptr()) return;
+    if (is_compilable(expr) && expr.slot() == Node_Impl::no_slot) {
+      Program prog;
+      vector<size_t> path;
+      if (compile_operand(expr, 0, path, prog, ctx)) {
+        ctx.programs.push_back(prog);
+        expr.set_slot(ctx.programs.size() - 1);
+        return;
+      }
+    }
+    for (size_t i = 0, S = expr.size(); i < S; ++i) compile(expr[i], ctx);
+  }
+
+  // Top-level assignments are evaluated when their variable is first read,
+  // as long as putting them off can't change the result: the right-hand
+  // side may only read variables that are already bound (anything else is
+  // evaluated right away, so unbound references are reported where they're
+  // made) and call builtins or pure functions, whose bodies only read their
+  // parameters and the locals they assign. Until it's read, the assignment
+  // itself sits in the variable's slot. Assigning to a variable that
+  // deferred assignments read evaluates them first, and so does defining a
+  // function, since they might call it.
+
+  static bool is_pure_callee(const Function& f, Context& ctx);
+
+  static bool is_deferrable(Node expr, Environment& global, vector<size_t>& reads, Context& ctx)
+  {
+    switch (expr.type())
+    {
+      case Node::variable: {
+        Node* binding = global.lookup(expr);
+        if (!binding) return false;
+        reads.push_back(binding - &global.slots[0]);
+        return true;
+      } break;
+
+      case Node::function_call: {
+        Node name(expr[0]);
+        Node args(expr[1]);
+        if (name.type() != Node::identifier || !name.symbol()) return false;
+        for (size_t i = 0, S = args.size(); i < S; ++i) {
+          Node arg(args[i].type() == Node::assignment ? args[i][1] : args[i]);
+          if (!is_deferrable(arg, global, reads, ctx)) return false;
+        }
+        map<pair<size_t, size_t>, Function>::iterator def = ctx.function_env.find(pair<size_t, size_t>(name.symbol(), args.size()));
+        return def == ctx.function_env.end() || is_pure_callee(def->second, ctx);
+      } break;
+
+      default: {
+        for (size_t i = 0, S = expr.size(); i < S; ++i) {
+          if (!is_deferrable(expr[i], global, reads, ctx)) return false;
+        }
+        return true;
+      } break;
+    }
+  }
+
+  static Node assigned_value(Node val, Node prefix, Environment& env, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx)
+  {
+    if (val.type() == Node::comma_list || val.type() == Node::space_list) {
+      for (size_t i = 0, S = val.size(); i < S; ++i) {
+        if (val[i].should_eval()) set_child(val, i, eval(val[i], prefix, env, f_env, new_Node, ctx), new_Node);
+      }
+      return val;
+    }
+    return eval(val, prefix, env, f_env, new_Node, ctx);
+  }
+
+  // the value bound in a slot, evaluating it first if it was deferred
+  static Node force(Node* binding, Node_Factory& new_Node, Context& ctx)
+  {
+    if (binding->is_null_ptr() || binding->type() != Node::assignment) return *binding;
+    *binding = assigned_value((*binding)[1], Node(), ctx.global_env, ctx.function_env, new_Node, ctx);
+    return *binding;
+  }
+
+  static void assign(Node* binding, Node val, Node_Factory& new_Node, Context& ctx)
+  {
+    vector<Node>& global = ctx.global_env.slots;
+    if (!ctx.readers.empty() && binding >= &global[0] && binding < &global[0] + global.size()) {
+      vector<size_t> readers;
+      readers.swap(ctx.readers[binding - &global[0]]);
+      for (size_t i = 0, S = readers.size(); i < S; ++i) force(&global[readers[i]], new_Node, ctx);
+    }
+    *binding = val;
+  }
+
+  static bool defer(Node assignment, Environment& global, Node_Factory& new_Node, Context& ctx)
+  {
+    vector<size_t> reads;
+    if (!is_deferrable(assignment[1], global, reads, ctx)) return false;
+    Node* binding = global.binding(assignment[0]);
+    if (!binding) return false;
+    size_t k = binding - &global.slots[0];
+    // reassignments in terms of the old value can't wait
+    if (find(reads.begin(), reads.end(), k) != reads.end()) return false;
+    assign(binding, assignment, new_Node, ctx);
+    ctx.readers.resize(global.slots.size());
+    for (size_t i = 0, S = reads.size(); i < S; ++i) ctx.readers[reads[i]].push_back(k);
+    ctx.deferred.push_back(k);
+    return true;
+  }
+
+  static void force_deferred(Node_Factory& new_Node, Context& ctx)
+  {
+    for (size_t i = 0, S = ctx.deferred.size(); i < S; ++i) {
+      force(&ctx.global_env.slots[ctx.deferred[i]], new_Node, ctx);
+    }
+    ctx.deferred.clear();
+    ctx.readers.clear();
+  }
+
+  // The machine's registers. Results are only boxed into nodes when they
+  // leave the machine.
+
+  struct Register {
+    enum Kind { number, dimension, other };
+
+    Kind   kind;
+    double value;
+    Token  unit;
+    Node   node;    // the value as a node, if there is one yet
+    Node   where;   // otherwise where to put it
+    bool   literal; // boxed with Node_Factory::number, like textual numbers
+    size_t chain;   // if node is the accumulator of an expression, its constant
+  };
+
+  enum { no_chain = ~size_t(0) };
+
+  static void load(Register& r, Node n)
+  {
+    r.node  = n;
+    r.chain = no_chain;
+    switch (n.type())
+    {
+      case Node::number:
+        r.kind  = Register::number;
+        r.value = n.numeric_value();
+        break;
+      case Node::numeric_dimension:
+        r.kind  = Register::dimension;
+        r.value = n.numeric_value();
+        r.unit  = n.unit();
+        break;
+      default:
+        r.kind  = Register::other;
+        break;
+    }
+  }
+
+  static void load(Register& r, Register::Kind kind, double value, Token unit, Node where, bool literal = false)
   {
-    if (!path.empty() && Prelexer::string_constant(path.c_str()))
-      path = path.substr(1, path.size() - 1);
+    r.kind    = kind;
+    r.value   = value;
+    r.unit    = unit;
+    r.node    = Node();
+    r.where   = where;
+    r.literal = literal;
+    r.chain   = no_chain;
+  }
 
-    throw Error(Error::evaluation, path, line, message);
+  static Node box(Register& r, Node_Factory& new_Node)
+  {
+    if (r.node.is_null_ptr()) {
+      if (r.kind == Register::dimension) r.node = new_Node(r.where.file(), r.where.offset(), r.value, r.unit);
+      else if (r.literal)                r.node = new_Node.number(r.where.file(), r.where.offset(), r.value);
+      else                               r.node = new_Node(r.where.file(), r.where.offset(), r.value);
+    }
+    return r.node;
+  }
+
+  static bool is_false(const Register& r)
+  { return r.kind == Register::other && r.node.type() == Node::boolean && !r.node.boolean_value(); }
+
+  static Node operand(Node expr, const Constant& c)
+  {
+    Node n(expr);
+    for (size_t i = 0, L = c.path.size(); i < L; ++i) n = n[c.path[i]];
+    return n;
+  }
+
+  // Operations on anything but numbers and dimensions of the same unit are
+  // done the way eval does them, on the operands already in the registers.
+
+  static void slow_arithmetic(Register& dst, Register& l, Register& r, const Instruction& in, const Constant& c, Node_Factory& new_Node)
+  {
+    Node acc;
+    if (l.chain == in.k) {
+      acc = l.node;
+    }
+    else {
+      acc = new_Node(Node::expression, c.node.file(), c.node.offset(), 1);
+      acc << box(l, new_Node);
+    }
+    accumulate(in.op, acc, box(r, new_Node), new_Node);
+    if (acc.size() == 1) {
+      load(dst, acc[0]);
+    }
+    else {
+      load(dst, acc);
+      dst.chain = in.k;
+    }
   }
 
+  static bool slow_compare(Node::Type op, Node lhs, Node rhs, Node where)
+  {
+    try {
+      switch (op)
+      {
+        case Node::eq:  return lhs == rhs;
+        case Node::neq: return lhs != rhs;
+        case Node::gt:  return lhs > rhs;
+        case Node::gte: return lhs >= rhs;
+        case Node::lt:  return lhs < rhs;
+        default:        return lhs <= rhs;
+      }
+    }
+    catch (Error& e) {
+      locate_error(e, where);
+      throw;
+    }
+  }
+
+  // Runs the program compiled for expr, if it has one. Returns false when
+  // the caller should walk the tree instead.
+  static bool execute(Node expr, Node& result, Node prefix, Environment& env, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx)
+  {
+    if (expr.slot() == Node_Impl::no_slot) return false;
+    Program& prog = ctx.programs[expr.slot()];
+
+    Register regs[Program::max_registers];
+    for (size_t pc = 0, S = prog.code.size(); pc < S; ++pc) {
+      const Instruction& in = prog.code[pc];
+      Register& dst = regs[in.dst];
+      switch (in.code)
+      {
+        case Instruction::load_number: {
+          const Constant& c = prog.constants[in.k];
+          load(dst, Register::number, c.number, c.unit, c.node, true);
+        } break;
+
+        case Instruction::load_dimension: {
+          const Constant& c = prog.constants[in.k];
+          load(dst, Register::dimension, c.number, c.unit, c.node);
+        } break;
+
+        case Instruction::load_variable: {
+          Node var(prog.constants[in.k].node);
+          Node* binding = env.lookup(var);
+          if (!binding) throw_eval_error("reference to unbound variable " + var.token().to_string(), var.file(), var.offset());
+          load(dst, force(binding, new_Node, ctx));
+        } break;
+
+        case Instruction::evaluate: {
+          load(dst, eval(operand(expr, prog.constants[in.k]), prefix, env, f_env, new_Node, ctx));
+        } break;
+
+        case Instruction::arithmetic: {
+          Register& l = regs[in.lhs];
+          Register& r = regs[in.rhs];
+          // mixed units need converting (or rejecting), like anything else
+          if (l.kind == Register::other || r.kind == Register::other ||
+              (l.kind == Register::dimension && r.kind == Register::dimension && !(l.unit == r.unit))) {
+            slow_arithmetic(dst, l, r, in, prog.constants[in.k], new_Node);
+            break;
+          }
+          double value = operate(in.op, l.value, r.value);
+          // same rules as accumulate
+          if (l.kind == Register::dimension && r.kind == Register::dimension && in.op == Node::div)
+          { load(dst, Register::number, value, Token::make(), prog.constants[in.k].node); }
+          else if (l.kind == Register::dimension)
+          { load(dst, Register::dimension, value, l.unit, prog.constants[in.k].node); }
+          else if (r.kind == Register::dimension)
+          { load(dst, Register::dimension, value, r.unit, prog.constants[in.k].node); }
+          else
+          { load(dst, Register::number, value, Token::make(), prog.constants[in.k].node); }
+        } break;
+
+        case Instruction::compare: {
+          Register& l = regs[in.lhs];
+          Register& r = regs[in.rhs];
+          bool b;
+          if (l.kind == Register::other || r.kind == Register::other ||
+              (l.kind == Register::dimension && r.kind == Register::dimension && !(l.unit == r.unit)) ||
+              (l.kind != r.kind && in.op != Node::eq && in.op != Node::neq)) {
+            b = slow_compare(in.op, box(l, new_Node), box(r, new_Node), prog.constants[in.k].node);
+          }
+          else if (l.kind != r.kind) {
+            // numbers and dimensions are never equal
+            b = in.op == Node::neq;
+          }
+          else {
+            // spelled out like Node's operators, so that NaNs compare the same
+            switch (in.op)
+            {
+              case Node::eq:  b = l.value == r.value; break;
+              case Node::neq: b = !(l.value == r.value); break;
+              case Node::lt:  b = l.value < r.value; break;
+              case Node::lte: b = l.value < r.value || l.value == r.value; break;
+              case Node::gt:  b = !(l.value < r.value || l.value == r.value); break;
+              default:        b = !(l.value < r.value); break;
+            }
+          }
+          load(dst, new_Node.boolean(b));
+        } break;
+
+        case Instruction::negate:
+        case Instruction::affirm: {
+          Register& l = regs[in.lhs];
+          const Constant& c = prog.constants[in.k];
+          if (l.kind == Register::other && !l.node.is_numeric()) {
+            // eval leaves the operator applied to the value
+            Node op(operand(expr, c));
+            set_child(op, 0, box(l, new_Node), new_Node);
+            load(dst, op);
+          }
+          else if (in.code == Instruction::negate) {
+            // units are dropped, as in eval
+            double value = l.kind != Register::other ? l.value : l.node.numeric_value();
+            load(dst, Register::number, -value, Token::make(), c.node);
+          }
+          else {
+            // the operand is returned as is
+            box(l, new_Node);
+            dst = l;
+          }
+        } break;
+
+        case Instruction::jump_if_false: {
+          if (is_false(regs[in.lhs])) pc = in.k - 1;
+        } break;
+
+        case Instruction::jump_unless_false: {
+          if (!is_false(regs[in.lhs])) pc = in.k - 1;
+        } break;
+      }
+    }
+    result = box(regs[0], new_Node);
+    return true;
+  }
+
+  // Loops evaluate their (shared) body in a single frame, which is emptied
+  // out before each iteration, and append the results to the loop node.
+  static void run_loop_body(Node& loop, Node body, Node prefix, Environment& frame, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx)
+  {
+    for (size_t i = 0, S = body.size(); i < S; ++i) {
+      loop << eval(body[i], prefix, frame, f_env, new_Node, ctx);
+    }
+  }
+
+  // Evaluation recurses on the C++ stack: at least once per level of nesting
+  // and per function or mixin call. Rather than overflowing the stack on
+  // runaway recursion, it fails once Context::max_depth calls of eval and
+  // function_eval are in progress.
+
+  struct Depth_Guard {
+    Context& ctx;
+
+    Depth_Guard(Node where, Context& ctx)
+    : ctx(ctx)
+    {
+      if (ctx.depth >= ctx.max_depth) {
+        stringstream ss;
+        ss << "evaluation nested too deeply (more than " << ctx.max_depth << " levels); is there infinite recursion?";
+        throw_eval_error(ss.str(), where.file(), where.offset());
+      }
+      ++ctx.depth;
+    }
+
+    ~Depth_Guard()
+    { --ctx.depth; }
+  };
+
   // Evaluate the parse tree in-place (mostly). Most nodes will be left alone.
 
-  Node eval(Node expr, Node prefix, Environment& env, map<pair<string, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx)
+  Node eval(Node expr, Node prefix, Environment& env, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx)
   {
+    Depth_Guard guard(expr, ctx);
     switch (expr.type())
     {
       case Node::mixin: {
-        env[expr[0].token()] = expr;
+        expr[2].freeze();
+        Environment& global = env.global ? *env.global : env;
+        global.slots[expr[0].slot()] = expr;
+        ctx.expansions.clear();
+        ctx.mixin_purity.clear();
         return expr;
       } break;
 
       case Node::function: {
-        f_env[pair<string, size_t>(expr[0].to_string(), expr[1].size())] = Function(expr);
+        // function_eval runs loop bodies over and over in place, so functions
+        // with loops get a private copy of their body on each call instead
+        Node def(expr);
+        if (!contains_loop(def[2]))  def[2].freeze();
+        else if (def[2].is_shared()) def = new_Node(def);
+        force_deferred(new_Node, ctx);
+        f_env[pair<size_t, size_t>(def[0].symbol(), def[1].size())] = Function(def);
+        // what callers of pure functions get back may depend on this one
+        ctx.memo.clear();
+        ctx.purity.clear();
+        ctx.expansions.clear();
+        ctx.mixin_purity.clear();
         return expr;
       } break;
       
       case Node::expansion: {
-        Token name(expr[0].token());
+        Node name(expr[0]);
         Node args(expr[1]);
-        if (!env.query(name)) throw_eval_error("mixin " + name.to_string() + " is undefined", expr.path(), expr.line());
-        Node mixin(env[name]);
+        Environment& global = env.global ? *env.global : env;
+        Node mixin(global.slots[name.slot()]);
+        if (mixin.is_null_ptr()) throw_eval_error("mixin " + name.to_string() + " is undefined", expr.file(), expr.offset());
         Node expansion(apply_mixin(mixin, args, prefix, env, f_env, new_Node, ctx));
+        expr = writable(expr, new_Node);
         expr.pop_back();
         expr.pop_back();
         expr += expansion;
@@ -46,18 +1032,21 @@ namespace Sass {
       } break;
       
       case Node::propset: {
-        eval(expr[1], prefix, env, f_env, new_Node, ctx);
+        set_child(expr, 1, eval(expr[1], prefix, env, f_env, new_Node, ctx), new_Node);
         return expr;
       } break;
 
       case Node::ruleset: {
         // if the selector contains interpolants, eval it and re-parse
         if (expr[0].type() == Node::selector_schema) {
-          expr[0] = eval(expr[0], prefix, env, f_env, new_Node, ctx);
+          set_child(expr, 0, eval(expr[0], prefix, env, f_env, new_Node, ctx), new_Node);
         }
 
         // expand the selector with the prefix and save it in expr[2]
+        expr = writable(expr, new_Node);
         expr << expand_selector(expr[0], prefix, new_Node);
+        // extension marks the selector, so it can't be the shared one
+        if (ctx.has_extensions && expr.back().is_shared()) expr.back() = new_Node(expr.back());
 
         // gather selector extensions into a pending queue
         if (ctx.has_extensions) {
@@ -85,103 +1074,96 @@ namespace Sass {
         }
 
         // eval the body with the current selector as the prefix
-        eval(expr[1], expr.back(), env, f_env, new_Node, ctx);
+        expr[1] = eval(expr[1], expr.back(), env, f_env, new_Node, ctx);
         return expr;
       } break;
 
       case Node::media_query: {
         Node block(expr[1]);
-        Node new_ruleset(new_Node(Node::ruleset, expr.path(), expr.line(), 3));
+        Node new_ruleset(new_Node(Node::ruleset, expr.file(), expr.offset(), 3));
         new_ruleset << prefix << block << prefix;
-        expr[1] = eval(new_ruleset, new_Node(Node::none, expr.path(), expr.line(), 0), env, f_env, new_Node, ctx);
+        set_child(expr, 1, eval(new_ruleset, new_Node(Node::none, expr.file(), expr.offset(), 0), env, f_env, new_Node, ctx), new_Node);
         return expr;
       } break;
 
       case Node::selector_schema: {
         string expansion;
         for (size_t i = 0, S = expr.size(); i < S; ++i) {
-          expr[i] = eval(expr[i], prefix, env, f_env, new_Node, ctx);
-          if (expr[i].type() == Node::string_constant) {
-            expansion += expr[i].token().unquote();
+          Node part(eval(expr[i], prefix, env, f_env, new_Node, ctx));
+          if (part.type() == Node::string_constant) {
+            expansion += part.token().unquote();
           }
           else {
-            expansion += expr[i].to_string();
+            expansion += part.to_string();
           }
         }
         expansion += " {"; // the parser looks for an lbrace to end a selector
         char* expn_src = new char[expansion.size() + 1];
         strcpy(expn_src, expansion.c_str());
-        Document needs_reparsing(Document::make_from_source_chars(ctx, expn_src, expr.path(), true));
-        needs_reparsing.line = expr.line(); // set the line number to the original node's line
+        Document needs_reparsing(Document::make_from_source_chars(ctx, expn_src, ctx.file_paths[expr.file()], true));
+        needs_reparsing.origin = 0; // not part of the file; attribute it to the original node
+        needs_reparsing.anchor = expr.offset();
         Node sel(needs_reparsing.parse_selector_group());
         return sel;
       } break;
       
       case Node::root: {
         for (size_t i = 0, S = expr.size(); i < S; ++i) {
-          expr[i] = eval(expr[i], prefix, env, f_env, new_Node, ctx);
+          set_child(expr, i, eval(expr[i], prefix, env, f_env, new_Node, ctx), new_Node);
         }
         return expr;
       } break;
       
       case Node::block: {
-        Environment new_frame;
+        Environment new_frame(ctx.scopes[expr.slot()]);
         new_frame.link(env);
         for (size_t i = 0, S = expr.size(); i < S; ++i) {
-          expr[i] = eval(expr[i], prefix, new_frame, f_env, new_Node, ctx);
+          set_child(expr, i, eval(expr[i], prefix, new_frame, f_env, new_Node, ctx), new_Node);
         }
         return expr;
       } break;
       
       case Node::assignment: {
-        Node val(expr[1]);
-        if (val.type() == Node::comma_list || val.type() == Node::space_list) {
-          for (size_t i = 0, S = val.size(); i < S; ++i) {
-            if (val[i].should_eval()) val[i] = eval(val[i], prefix, env, f_env, new_Node, ctx);
-          }
-        }
-        else {
-          val = eval(val, prefix, env, f_env, new_Node, ctx);
-        }
         Node var(expr[0]);
-        if (expr.is_guarded() && env.query(var.token())) return expr;
+        if (expr.is_guarded() && env.lookup(var)) return expr;
+        if (&env == &ctx.global_env && defer(expr, env, new_Node, ctx)) return expr;
+        Node val(assigned_value(expr[1], prefix, env, f_env, new_Node, ctx));
         // If a binding exists (possible upframe), then update it.
         // Otherwise, make a new on in the current frame.
-        if (env.query(var.token())) {
-          env[var.token()] = val;
-        }
-        else {
-          env.current_frame[var.token()] = val;
-        }
+        Node* binding = env.binding(var);
+        if (!binding) throw_eval_error("cannot assign to " + var.token().to_string() + " here", var.file(), var.offset());
+        assign(binding, val, new_Node, ctx);
         return expr;
       } break;
 
       case Node::rule: {
         Node lhs(expr[0]);
-        if (lhs.should_eval()) eval(lhs, prefix, env, f_env, new_Node, ctx);
+        if (lhs.should_eval()) set_child(expr, 0, eval(lhs, prefix, env, f_env, new_Node, ctx), new_Node);
         Node rhs(expr[1]);
         if (rhs.type() == Node::comma_list || rhs.type() == Node::space_list) {
           for (size_t i = 0, S = rhs.size(); i < S; ++i) {
-            if (rhs[i].should_eval()) rhs[i] = eval(rhs[i], prefix, env, f_env, new_Node, ctx);
+            if (rhs[i].should_eval()) set_child(rhs, i, eval(rhs[i], prefix, env, f_env, new_Node, ctx), new_Node);
           }
+          set_child(expr, 1, rhs, new_Node);
         }
         else if (rhs.type() == Node::value_schema || rhs.type() == Node::string_schema) {
-          eval(rhs, prefix, env, f_env, new_Node, ctx);
+          set_child(expr, 1, eval(rhs, prefix, env, f_env, new_Node, ctx), new_Node);
         }
         else {
-          if (rhs.should_eval()) expr[1] = eval(rhs, prefix, env, f_env, new_Node, ctx);
+          if (rhs.should_eval()) set_child(expr, 1, eval(rhs, prefix, env, f_env, new_Node, ctx), new_Node);
         }
         return expr;
       } break;
 
       case Node::comma_list:
       case Node::space_list: {
-        if (expr.should_eval()) expr[0] = eval(expr[0], prefix, env, f_env, new_Node, ctx);
+        if (expr.should_eval()) set_child(expr, 0, eval(expr[0], prefix, env, f_env, new_Node, ctx), new_Node);
         return expr;
       } break;
       
       case Node::disjunction: {
         Node result;
+        if (execute(expr, result, prefix, env, f_env, new_Node, ctx)) return result;
         for (size_t i = 0, S = expr.size(); i < S; ++i) {
           result = eval(expr[i], prefix, env, f_env, new_Node, ctx);
           if (result.type() == Node::boolean && result.boolean_value() == false) continue;
@@ -192,6 +1174,7 @@ namespace Sass {
       
       case Node::conjunction: {
         Node result;
+        if (execute(expr, result, prefix, env, f_env, new_Node, ctx)) return result;
         for (size_t i = 0, S = expr.size(); i < S; ++i) {
           result = eval(expr[i], prefix, env, f_env, new_Node, ctx);
           if (result.type() == Node::boolean && result.boolean_value() == false) return result;
@@ -200,30 +1183,38 @@ namespace Sass {
       } break;
       
       case Node::relation: {
-        
+        Node result;
+        if (execute(expr, result, prefix, env, f_env, new_Node, ctx)) return result;
         Node lhs(eval(expr[0], prefix, env, f_env, new_Node, ctx));
         Node op(expr[1]);
         Node rhs(eval(expr[2], prefix, env, f_env, new_Node, ctx));
-        // TO DO: don't allocate both T and F
-        Node T(new_Node(Node::boolean, lhs.path(), lhs.line(), true));
-        Node F(new_Node(Node::boolean, lhs.path(), lhs.line(), false));
+        Node T(new_Node.boolean(true));
+        Node F(new_Node.boolean(false));
         
-        switch (op.type())
-        {
-          case Node::eq:  return (lhs == rhs) ? T : F;
-          case Node::neq: return (lhs != rhs) ? T : F;
-          case Node::gt:  return (lhs > rhs)  ? T : F;
-          case Node::gte: return (lhs >= rhs) ? T : F;
-          case Node::lt:  return (lhs < rhs)  ? T : F;
-          case Node::lte: return (lhs <= rhs) ? T : F;
-          default:
-            throw_eval_error("unknown comparison operator " + expr.token().to_string(), expr.path(), expr.line());
-            return Node();
+        try {
+          switch (op.type())
+          {
+            case Node::eq:  return (lhs == rhs) ? T : F;
+            case Node::neq: return (lhs != rhs) ? T : F;
+            case Node::gt:  return (lhs > rhs)  ? T : F;
+            case Node::gte: return (lhs >= rhs) ? T : F;
+            case Node::lt:  return (lhs < rhs)  ? T : F;
+            case Node::lte: return (lhs <= rhs) ? T : F;
+            default:
+              throw_eval_error("unknown comparison operator " + expr.token().to_string(), expr.file(), expr.offset());
+              return Node();
+          }
+        }
+        catch (Error& e) {
+          locate_error(e, expr);
+          throw;
         }
       } break;
 
       case Node::expression: {
-        Node acc(new_Node(Node::expression, expr.path(), expr.line(), 1));
+        Node result;
+        if (execute(expr, result, prefix, env, f_env, new_Node, ctx)) return result;
+        Node acc(new_Node(Node::expression, expr.file(), expr.offset(), 1));
         acc << eval(expr[0], prefix, env, f_env, new_Node, ctx);
         Node rhs(eval(expr[2], prefix, env, f_env, new_Node, ctx));
         accumulate(expr[1].type(), acc, rhs, new_Node);
@@ -236,7 +1227,9 @@ namespace Sass {
 
       case Node::term: {
         if (expr.should_eval()) {
-          Node acc(new_Node(Node::expression, expr.path(), expr.line(), 1));
+          Node result;
+          if (execute(expr, result, prefix, env, f_env, new_Node, ctx)) return result;
+          Node acc(new_Node(Node::expression, expr.file(), expr.offset(), 1));
           acc << eval(expr[0], prefix, env, f_env, new_Node, ctx);
           Node rhs(eval(expr[2], prefix, env, f_env, new_Node, ctx));
           accumulate(expr[1].type(), acc, rhs, new_Node);
@@ -252,56 +1245,65 @@ namespace Sass {
       } break;
 
       case Node::textual_percentage: {
-        return new_Node(expr.path(), expr.line(), std::atof(expr.token().begin), Node::numeric_percentage);
+        return new_Node(expr.file(), expr.offset(), expr.numeric_value(), Node::numeric_percentage);
       } break;
 
       case Node::textual_dimension: {
-        return new_Node(expr.path(), expr.line(),
-                        std::atof(expr.token().begin),
+        return new_Node(expr.file(), expr.offset(),
+                        expr.numeric_value(),
                         Token::make(Prelexer::number(expr.token().begin),
                                     expr.token().end));
       } break;
       
       case Node::textual_number: {
-        return new_Node(expr.path(), expr.line(), std::atof(expr.token().begin));
+        return new_Node.number(expr.file(), expr.offset(), expr.numeric_value());
       } break;
 
-      case Node::textual_hex: {        
-        Node triple(new_Node(Node::numeric_color, expr.path(), expr.line(), 4));
-        Token hext(Token::make(expr.token().begin+1, expr.token().end));
-        if (hext.length() == 6) {
-          for (int i = 0; i < 6; i += 2) {
-            triple << new_Node(expr.path(), expr.line(), static_cast<double>(std::strtol(string(hext.begin+i, 2).c_str(), NULL, 16)));
-          }
-        }
-        else {
-          for (int i = 0; i < 3; ++i) {
-            triple << new_Node(expr.path(), expr.line(), static_cast<double>(std::strtol(string(2, hext.begin[i]).c_str(), NULL, 16)));
-          }
-        }
-        triple << new_Node(expr.path(), expr.line(), 1.0);
+      case Node::textual_hex: {
+        unsigned long rgb = static_cast<unsigned long>(expr.numeric_value());
+        Node triple(new_Node(Node::numeric_color, expr.file(), expr.offset(), 4));
+        triple << new_Node.number(expr.file(), expr.offset(), static_cast<double>((rgb >> 16) & 0xff));
+        triple << new_Node.number(expr.file(), expr.offset(), static_cast<double>((rgb >> 8) & 0xff));
+        triple << new_Node.number(expr.file(), expr.offset(), static_cast<double>(rgb & 0xff));
+        triple << new_Node.number(expr.file(), expr.offset(), 1.0);
         return triple;
       } break;
       
       case Node::variable: {
-        if (!env.query(expr.token())) throw_eval_error("reference to unbound variable " + expr.token().to_string(), expr.path(), expr.line());
-        return env[expr.token()];
+        Node* binding = env.lookup(expr);
+        if (!binding) throw_eval_error("reference to unbound variable " + expr.token().to_string(), expr.file(), expr.offset());
+        return force(binding, new_Node, ctx);
       } break;
       
       case Node::function_call: {
         // TO DO: default-constructed Function should be a generic callback (maybe)
-        // eval the function name in case it's interpolated
-        expr[0] = eval(expr[0], prefix, env, f_env, new_Node, ctx);
-        pair<string, size_t> sig(expr[0].to_string(), expr[1].size());
-        if (!f_env.count(sig)) {
+        // Call sites remember what they resolved to. Entries in f_env are never
+        // erased and @function overwrites them in place, so the pointer stays
+        // valid and picks up redefinitions. It isn't part of the call's value,
+        // so it's fine to cache it on a shared node.
+        const Function* f = expr.callee();
+        if (!f) {
+          // eval the function name in case it's interpolated
+          set_child(expr, 0, eval(expr[0], prefix, env, f_env, new_Node, ctx), new_Node);
+          // interpolated names only get a symbol once they've been evaluated
+          Node name(expr[0]);
+          pair<size_t, size_t> sig(name.symbol() ? name.symbol() : ctx.symbol(name.to_string()), expr[1].size());
+          map<pair<size_t, size_t>, Function>::iterator def = f_env.find(sig);
+          if (def != f_env.end()) {
+            f = &def->second;
+            if (name.symbol()) expr.callee() = f;
+          }
+        }
+        if (!f) {
           Node args(expr[1]);
           for (size_t i = 0, S = args.size(); i < S; ++i) {
-            args[i] = eval(args[i], prefix, env, f_env, new_Node, ctx);
+            set_child(args, i, eval(args[i], prefix, env, f_env, new_Node, ctx), new_Node);
           }
+          set_child(expr, 1, args, new_Node);
           return expr;
         }
         else {
-          return apply_function(f_env[sig], expr[1], prefix, env, f_env, new_Node, ctx);
+          return apply_function(*f, expr[1], prefix, env, f_env, new_Node, ctx);
         }
       } break;
       
@@ -311,7 +1313,7 @@ namespace Sass {
           return arg;
         }
         else {
-          expr[0] = arg;
+          set_child(expr, 0, arg, new_Node);
           return expr;
         }
       } break;
@@ -319,10 +1321,10 @@ namespace Sass {
       case Node::unary_minus: {
         Node arg(eval(expr[0], prefix, env, f_env, new_Node, ctx));
         if (arg.is_numeric()) {
-          return new_Node(expr.path(), expr.line(), -arg.numeric_value());
+          return new_Node(expr.file(), expr.offset(), -arg.numeric_value());
         }
         else {
-          expr[0] = arg;
+          set_child(expr, 0, arg, new_Node);
           return expr;
         }
       } break;
@@ -331,13 +1333,13 @@ namespace Sass {
       case Node::value_schema:
       case Node::identifier_schema: {
         for (size_t i = 0, S = expr.size(); i < S; ++i) {
-          expr[i] = eval(expr[i], prefix, env, f_env, new_Node, ctx);
+          set_child(expr, i, eval(expr[i], prefix, env, f_env, new_Node, ctx), new_Node);
         }
         return expr;
       } break;
       
       case Node::css_import: {
-        expr[0] = eval(expr[0], prefix, env, f_env, new_Node, ctx);
+        set_child(expr, 0, eval(expr[0], prefix, env, f_env, new_Node, ctx), new_Node);
         return expr;
       } break;
 
@@ -360,71 +1362,92 @@ namespace Sass {
 
       case Node::for_through_directive:
       case Node::for_to_directive: {
-        Node fake_mixin(new_Node(Node::mixin, expr.path(), expr.line(), 3));
-        Node fake_param(new_Node(Node::parameters, expr.path(), expr.line(), 1));
-        fake_mixin << new_Node(Node::none, "", 0, 0) << (fake_param << expr[0]) << expr[3];
+        expr = writable(expr, new_Node);
+        Node iter_var(expr[0]);
+        Node body(expr[3]);
+        body.freeze();
         Node lower_bound(eval(expr[1], prefix, env, f_env, new_Node, ctx));
         Node upper_bound(eval(expr[2], prefix, env, f_env, new_Node, ctx));
         if (!(lower_bound.is_numeric() && upper_bound.is_numeric())) {
-          throw_eval_error("bounds of @for directive must be numeric", expr.path(), expr.line());
+          throw_eval_error("bounds of @for directive must be numeric", expr.file(), expr.offset());
         }
         expr.pop_back();
         expr.pop_back();
         expr.pop_back();
         expr.pop_back();
+        Environment for_env(ctx.scopes[expr.slot()]);
+        for_env.link(env);
         for (double i = lower_bound.numeric_value(),
                     U = upper_bound.numeric_value() + ((expr.type() == Node::for_to_directive) ? 0 : 1);
              i < U;
              ++i) {
-          Node i_node(new_Node(expr.path(), expr.line(), i));
-          Node fake_arg(new_Node(Node::arguments, expr.path(), expr.line(), 1));
-          fake_arg << i_node;
-          expr += apply_mixin(fake_mixin, fake_arg, prefix, env, f_env, new_Node, ctx, true);
+          for_env.reset();
+          for_env.slots[iter_var.slot()] = new_Node(expr.file(), expr.offset(), i);
+          run_loop_body(expr, body, prefix, for_env, f_env, new_Node, ctx);
         }
       } break;
 
       case Node::each_directive: {
-        Node fake_mixin(new_Node(Node::mixin, expr.path(), expr.line(), 3));
-        Node fake_param(new_Node(Node::parameters, expr.path(), expr.line(), 1));
-        fake_mixin << new_Node(Node::none, "", 0, 0) << (fake_param << expr[0]) << expr[2];
+        expr = writable(expr, new_Node);
+        Node iter_var(expr[0]);
+        Node body(expr[2]);
+        body.freeze();
         Node list(eval(expr[1], prefix, env, f_env, new_Node, ctx));
         // If the list isn't really a list, make a singleton out of it.
         if (list.type() != Node::space_list && list.type() != Node::comma_list) {
-          list = (new_Node(Node::space_list, list.path(), list.line(), 1) << list);
+          list = (new_Node(Node::space_list, list.file(), list.offset(), 1) << list);
         }
         expr.pop_back();
         expr.pop_back();
         expr.pop_back();
+        Environment each_env(ctx.scopes[expr.slot()]);
+        each_env.link(env);
         for (size_t i = 0, S = list.size(); i < S; ++i) {
-          Node fake_arg(new_Node(Node::arguments, expr.path(), expr.line(), 1));
-          fake_arg << eval(list[i], prefix, env, f_env, new_Node, ctx);
-          expr += apply_mixin(fake_mixin, fake_arg, prefix, env, f_env, new_Node, ctx, true);
+          Node value(eval(list[i], prefix, env, f_env, new_Node, ctx));
+          each_env.reset();
+          each_env.slots[iter_var.slot()] = value;
+          run_loop_body(expr, body, prefix, each_env, f_env, new_Node, ctx);
         }
       } break;
 
       case Node::while_directive: {
-        Node fake_mixin(new_Node(Node::mixin, expr.path(), expr.line(), 3));
-        Node fake_param(new_Node(Node::parameters, expr.path(), expr.line(), 0));
-        Node fake_arg(new_Node(Node::arguments, expr.path(), expr.line(), 0));
-        fake_mixin << new_Node(Node::none, "", 0, 0) << fake_param << expr[1];
+        expr = writable(expr, new_Node);
         Node pred(expr[0]);
+        Node body(expr[1]);
+        body.freeze();
         expr.pop_back();
         expr.pop_back();
+        Environment while_env(ctx.scopes[expr.slot()]);
+        while_env.link(env);
         Node ev_pred(eval(pred, prefix, env, f_env, new_Node, ctx));
         while ((ev_pred.type() != Node::boolean) || ev_pred.boolean_value()) {
-          expr += apply_mixin(fake_mixin, fake_arg, prefix, env, f_env, new_Node, ctx, true);
+          while_env.reset();
+          run_loop_body(expr, body, prefix, while_env, f_env, new_Node, ctx);
           ev_pred = eval(pred, prefix, env, f_env, new_Node, ctx);
         }
       } break;
 
       case Node::block_directive: {
         // TO DO: eval the directive name for interpolants
-        eval(expr[1], new_Node(Node::none, expr.path(), expr.line(), 0), env, f_env, new_Node, ctx);
+        set_child(expr, 1, eval(expr[1], new_Node(Node::none, expr.file(), expr.offset(), 0), env, f_env, new_Node, ctx), new_Node);
         return expr;
       } break;
 
       case Node::warning: {
-        expr[0] = eval(expr[0], prefix, env, f_env, new_Node, ctx);
+        set_child(expr, 0, eval(expr[0], prefix, env, f_env, new_Node, ctx), new_Node);
+        string label("WARNING: ");
+        string indent("         ");
+        Node contents(expr[0]);
+        string result(contents.to_string());
+        if (contents.type() == Node::string_constant || contents.type() == Node::string_schema) {
+          result = result.substr(1, result.size()-2); // unquote if it's a single string
+        }
+        // canonical values have no position of their own (see locate_error)
+        Node where(contents.file() || contents.offset() ? contents : expr);
+        // These cerrs aren't log lines! They're supposed to be here!
+        cerr << label << result << endl;
+        cerr << indent << "on line " << ctx.line_of(where.file(), where.offset()) << " of " << ctx.file_paths[where.file()];
+        cerr << endl << endl;
         return expr;
       } break;
 
@@ -447,28 +1470,36 @@ namespace Sass {
     double rnum = rhs.numeric_value();
     
     if (lhs.type() == Node::number && rhs.type() == Node::number) {
-      Node result(new_Node(acc.path(), acc.line(), operate(op, lnum, rnum)));
+      Node result(new_Node(acc.file(), acc.offset(), operate(op, lnum, rnum)));
       acc.pop_back();
       acc.push_back(result);
     }
     // TO DO: find a way to merge the following two clauses
     else if (lhs.type() == Node::number && rhs.type() == Node::numeric_dimension) {
-      Node result(new_Node(acc.path(), acc.line(), operate(op, lnum, rnum), rhs.unit()));
+      Node result(new_Node(acc.file(), acc.offset(), operate(op, lnum, rnum), rhs.unit()));
       acc.pop_back();
       acc.push_back(result);
     }
     else if (lhs.type() == Node::numeric_dimension && rhs.type() == Node::number) {
-      Node result(new_Node(acc.path(), acc.line(), operate(op, lnum, rnum), lhs.unit()));
+      Node result(new_Node(acc.file(), acc.offset(), operate(op, lnum, rnum), lhs.unit()));
       acc.pop_back();
       acc.push_back(result);
     }
     else if (lhs.type() == Node::numeric_dimension && rhs.type() == Node::numeric_dimension) {
-      // TO DO: CHECK FOR MISMATCHED UNITS HERE
+      // sums and differences are worked out in the left-hand unit, so the
+      // two have to convert into one another; products and quotients don't
+      // convert anything
+      if (op == Node::add || op == Node::sub) {
+        if (!Unit::comparable(lhs.unit_id(), lhs.unit(), rhs.unit_id(), rhs.unit())) {
+          throw_eval_error("incompatible units " + lhs.unit().to_string() + " and " + rhs.unit().to_string(), lhs.file(), lhs.offset());
+        }
+        rnum = Unit::convert(rnum, rhs.unit_id(), lhs.unit_id());
+      }
       Node result;
       if (op == Node::div)
-      { result = new_Node(acc.path(), acc.line(), operate(op, lnum, rnum)); }
+      { result = new_Node(acc.file(), acc.offset(), operate(op, lnum, rnum)); }
       else
-      { result = new_Node(acc.path(), acc.line(), operate(op, lnum, rnum), lhs.unit()); }
+      { result = new_Node(acc.file(), acc.offset(), operate(op, lnum, rnum), lhs.unit()); }
       acc.pop_back();
       acc.push_back(result);
     }
@@ -480,15 +1511,15 @@ namespace Sass {
         double b = operate(op, lhs.numeric_value(), rhs[2].numeric_value());
         double a = rhs[3].numeric_value();
         acc.pop_back();
-        acc << new_Node(acc.path(), acc.line(), r, g, b, a);
+        acc << new_Node(acc.file(), acc.offset(), r, g, b, a);
       }
       // trying to handle weird edge cases ... not sure if it's worth it
       else if (op == Node::div) {
-        acc << new_Node(Node::div, acc.path(), acc.line(), 0);
+        acc << new_Node(Node::div, acc.file(), acc.offset(), 0);
         acc << rhs;
       }
       else if (op == Node::sub) {
-        acc << new_Node(Node::sub, acc.path(), acc.line(), 0);
+        acc << new_Node(Node::sub, acc.file(), acc.offset(), 0);
         acc << rhs;
       }
       else {
@@ -501,23 +1532,23 @@ namespace Sass {
       double b = operate(op, lhs[2].numeric_value(), rhs.numeric_value());
       double a = lhs[3].numeric_value();
       acc.pop_back();
-      acc << new_Node(acc.path(), acc.line(), r, g, b, a);
+      acc << new_Node(acc.file(), acc.offset(), r, g, b, a);
     }
     else if (lhs.type() == Node::numeric_color && rhs.type() == Node::numeric_color) {
-      if (lhs[3].numeric_value() != rhs[3].numeric_value()) throw_eval_error("alpha channels must be equal for " + lhs.to_string() + " + " + rhs.to_string(), lhs.path(), lhs.line());
+      if (lhs[3].numeric_value() != rhs[3].numeric_value()) throw_eval_error("alpha channels must be equal for " + lhs.to_string() + " + " + rhs.to_string(), lhs.file(), lhs.offset());
       double r = operate(op, lhs[0].numeric_value(), rhs[0].numeric_value());
       double g = operate(op, lhs[1].numeric_value(), rhs[1].numeric_value());
       double b = operate(op, lhs[2].numeric_value(), rhs[2].numeric_value());
       double a = lhs[3].numeric_value();
       acc.pop_back();
-      acc << new_Node(acc.path(), acc.line(), r, g, b, a);
+      acc << new_Node(acc.file(), acc.offset(), r, g, b, a);
     }
     else if (lhs.type() == Node::concatenation && rhs.type() == Node::concatenation) {
       if (op == Node::add) {
         lhs += rhs;
       }
       else {
-        acc << new_Node(op, acc.path(), acc.line(), Token::make());
+        acc << new_Node(op, acc.file(), acc.offset(), Token::make());
         acc << rhs;
       }
     }
@@ -526,38 +1557,38 @@ namespace Sass {
         lhs << rhs;
       }
       else {
-        acc << new_Node(op, acc.path(), acc.line(), Token::make());
+        acc << new_Node(op, acc.file(), acc.offset(), Token::make());
         acc << rhs;
       }
     }
     else if (lhs.type() == Node::string_constant && rhs.type() == Node::concatenation) {
       if (op == Node::add) {
-        Node new_cat(new_Node(Node::concatenation, lhs.path(), lhs.line(), 1 + rhs.size()));
+        Node new_cat(new_Node(Node::concatenation, lhs.file(), lhs.offset(), 1 + rhs.size()));
         new_cat << lhs;
         new_cat += rhs;
         acc.pop_back();
         acc << new_cat;
       }
       else {
-        acc << new_Node(op, acc.path(), acc.line(), Token::make());
+        acc << new_Node(op, acc.file(), acc.offset(), Token::make());
         acc << rhs;
       }
     }
     else if (lhs.type() == Node::string_constant && rhs.type() == Node::string_constant) {
       if (op == Node::add) {
-        Node new_cat(new_Node(Node::concatenation, lhs.path(), lhs.line(), 2));
+        Node new_cat(new_Node(Node::concatenation, lhs.file(), lhs.offset(), 2));
         new_cat << lhs << rhs;
         acc.pop_back();
         acc << new_cat;
       }
       else {
-        acc << new_Node(op, acc.path(), acc.line(), Token::make());
+        acc << new_Node(op, acc.file(), acc.offset(), Token::make());
         acc << rhs;
       }
     }
     else {
       // TO DO: disallow division and multiplication on lists
-      if (op == Node::sub) acc << new_Node(Node::sub, acc.path(), acc.line(), Token::make());
+      if (op == Node::sub) acc << new_Node(Node::sub, acc.file(), acc.offset(), Token::make());
       acc.push_back(rhs);
     }
 
@@ -578,21 +1609,215 @@ namespace Sass {
     }
   }
 
+  // Calls to pure functions and expansions of pure mixins are memoized. A
+  // function or mixin is pure if it can't see or change anything but its
+  // arguments: every variable in its body is bound within it (the chain of
+  // scopes it resolves through never reaches the global one), every function
+  // it calls is a builtin, plain CSS, or pure itself, and likewise for the
+  // mixins it includes. It mustn't define anything or print warnings either.
+  // Callees are looked up as they're defined right now, so defining a
+  // function or mixin throws away everything that's been worked out.
+
+  static bool is_pure(const Function& f, Context& ctx);
+  static bool is_pure_mixin(Node mixin, Context& ctx);
+  static bool is_pure_callee(const Function& f, Context& ctx);
+
+  static bool is_local(Node var, size_t scope, Context& ctx)
+  {
+    size_t k = var.slot();
+    if (k >= ctx.scopes[scope].symbols.size() || ctx.scopes[scope].symbols[k] != var.symbol()) return false;
+    for (;;) {
+      const Scope::Link& up = ctx.scopes[scope].outer[k];
+      // a name nothing binds is an error waiting to be reported
+      if (!up.depth) return ctx.scopes[scope].binds[k];
+      for (size_t d = up.depth; d; --d) scope = ctx.scopes[scope].parent;
+      if (!scope) return false;
+      k = up.slot;
+    }
+  }
+
+  static bool mentions_variables(Node expr)
+  {
+    if (expr.type() == Node::variable) return true;
+    for (size_t i = 0, S = expr.size(); i < S; ++i) {
+      if (mentions_variables(expr[i])) return true;
+    }
+    return false;
+  }
+
+  // Default arguments are evaluated in the caller's frame, so a callee whose
+  // defaults read variables can see more than its arguments. The parameters
+  // themselves are variables too, but binding them reads nothing.
+  static bool defaults_mention_variables(Node params)
+  {
+    for (size_t i = 0, S = params.size(); i < S; ++i) {
+      if (params[i].type() == Node::assignment && mentions_variables(params[i][1])) return true;
+    }
+    return false;
+  }
+
+  static bool is_self_contained(Node expr, size_t scope, Context& ctx)
+  {
+    switch (expr.type())
+    {
+      case Node::variable:
+        return is_local(expr, scope, ctx);
+
+      case Node::function_call: {
+        Node name(expr[0]);
+        Node args(expr[1]);
+        if (name.type() != Node::identifier || !name.symbol()) return false;
+        for (size_t i = 0, S = args.size(); i < S; ++i) {
+          Node arg(args[i].type() == Node::assignment ? args[i][1] : args[i]);
+          if (!is_self_contained(arg, scope, ctx)) return false;
+        }
+        map<pair<size_t, size_t>, Function>::iterator def = ctx.function_env.find(pair<size_t, size_t>(name.symbol(), args.size()));
+        return def == ctx.function_env.end() || is_pure_callee(def->second, ctx);
+      } break;
+
+      case Node::expansion: {
+        Node name(expr[0]);
+        Node args(expr[1]);
+        for (size_t i = 0, S = args.size(); i < S; ++i) {
+          Node arg(args[i].type() == Node::assignment ? args[i][1] : args[i]);
+          if (!is_self_contained(arg, scope, ctx)) return false;
+        }
+        Node mixin(ctx.global_env.slots[name.slot()]);
+        if (mixin.is_null_ptr() || defaults_mention_variables(mixin[1])) return false;
+        return is_pure_mixin(mixin, ctx);
+      } break;
+
+      case Node::mixin:
+      case Node::function:
+      case Node::warning:
+        return false;
+
+      // blocks only open scopes of their own outside of functions
+      case Node::block: {
+        if (expr.slot() != Node_Impl::no_slot) scope = expr.slot();
+        for (size_t i = 0, S = expr.size(); i < S; ++i) {
+          if (!is_self_contained(expr[i], scope, ctx)) return false;
+        }
+        return true;
+      } break;
+
+      case Node::for_through_directive:
+      case Node::for_to_directive:
+        return is_self_contained(expr[1], scope, ctx) &&
+               is_self_contained(expr[2], scope, ctx) &&
+               is_self_contained(expr[3], expr.slot(), ctx);
+
+      case Node::each_directive:
+        return is_self_contained(expr[1], scope, ctx) &&
+               is_self_contained(expr[2], expr.slot(), ctx);
+
+      case Node::while_directive:
+        return is_self_contained(expr[0], scope, ctx) &&
+               is_self_contained(expr[1], expr.slot(), ctx);
+
+      default: {
+        for (size_t i = 0, S = expr.size(); i < S; ++i) {
+          if (!is_self_contained(expr[i], scope, ctx)) return false;
+        }
+        return true;
+      } break;
+    }
+  }
+
+  static bool is_pure(const Function& f, Context& ctx)
+  {
+    map<const Function*, bool>::iterator known = ctx.purity.find(&f);
+    if (known != ctx.purity.end()) return known->second;
+    // assume the best of recursive calls while the body's being checked
+    ctx.purity[&f] = true;
+    bool pure = is_self_contained(f.definition[2], f.definition.slot(), ctx);
+    ctx.purity[&f] = pure;
+    return pure;
+  }
+
+  // whether calling f from a pure body keeps the body pure
+  static bool is_pure_callee(const Function& f, Context& ctx)
+  {
+    if (f.primitive) return true;
+    return !defaults_mention_variables(f.definition[1]) && is_pure(f, ctx);
+  }
+
+  static bool is_pure_mixin(Node mixin, Context& ctx)
+  {
+    map<size_t, bool>::iterator known = ctx.mixin_purity.find(mixin.slot());
+    if (known != ctx.mixin_purity.end()) return known->second;
+    ctx.mixin_purity[mixin.slot()] = true;
+    bool pure = is_self_contained(mixin[2], mixin.slot(), ctx);
+    ctx.mixin_purity[mixin.slot()] = pure;
+    return pure;
+  }
+
+  // Encodes a value as part of a memo key. Only plain data (numbers, colors,
+  // strings, booleans and lists of them) is encoded; anything else can't be
+  // compared structurally, and might get changed in place after the fact.
+  static bool memo_key(Node val, string& key)
+  {
+    key += static_cast<char>(val.type());
+    switch (val.type())
+    {
+      case Node::number:
+      case Node::numeric_percentage:
+      case Node::numeric_dimension: {
+        double value = val.numeric_value();
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        if (val.type() == Node::numeric_dimension) {
+          key += val.unit().to_string();
+          key += '\0';
+        }
+      } break;
+
+      case Node::boolean: {
+        key += val.boolean_value() ? 't' : 'f';
+      } break;
+
+      case Node::nil: {
+      } break;
+
+      case Node::identifier:
+      case Node::string_constant: {
+        key += val.is_unquoted() ? 'u' : '-';
+        key += val.is_quoted() ? 'q' : '-';
+        key += val.token().to_string();
+        key += '\0';
+      } break;
+
+      case Node::numeric_color:
+      case Node::comma_list:
+      case Node::space_list: {
+        size_t size = val.size();
+        key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        for (size_t i = 0; i < size; ++i) {
+          if (!memo_key(val[i], key)) return false;
+        }
+      } break;
+
+      default:
+        return false;
+    }
+    return true;
+  }
+
   // Apply a mixin -- bind the arguments in a new environment, link the new
-  // environment to the current one, then copy the body and eval in the new
+  // environment to the current one, then eval the (shared) body in the new
   // environment.
   
-  Node apply_mixin(Node mixin, const Node args, Node prefix, Environment& env, map<pair<string, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx, bool dynamic_scope)
+  Node apply_mixin(Node mixin, const Node args, Node prefix, Environment& env, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx)
   {
     Node params(mixin[1]);
-    Node body(new_Node(mixin[2])); // clone the body
-    Environment bindings;
+    Node body(mixin[2]); // shared; eval copies whatever it changes
+    Environment bindings(ctx.scopes[mixin.slot()]);
     // TO DO: REFACTOR THE ARG-BINDER
     // bind arguments
     for (size_t i = 0, j = 0, S = args.size(); i < S; ++i) {
       if (args[i].type() == Node::assignment) {
         Node arg(args[i]);
         Token name(arg[0].token());
+        size_t slot = 0;
         // check that the keyword arg actually names a formal parameter
         bool valid_param = false;
         for (size_t k = 0, S = params.size(); k < S; ++k) {
@@ -600,12 +1825,13 @@ namespace Sass {
           if (param_k.type() == Node::assignment) param_k = param_k[0];
           if (arg[0] == param_k) {
             valid_param = true;
+            slot = param_k.slot();
             break;
           }
         }
-        if (!valid_param) throw_eval_error("mixin " + mixin[0].to_string() + " has no parameter named " + name.to_string(), arg.path(), arg.line());
-        if (!bindings.query(name)) {
-          bindings[name] = eval(arg[1], prefix, env, f_env, new_Node, ctx);
+        if (!valid_param) throw_eval_error("mixin " + mixin[0].to_string() + " has no parameter named " + name.to_string(), arg.file(), arg.offset());
+        if (bindings.slots[slot].is_null_ptr()) {
+          bindings.slots[slot] = eval(arg[1], prefix, env, f_env, new_Node, ctx);
         }
       }
       else {
@@ -613,11 +1839,11 @@ namespace Sass {
         if (j >= params.size()) {
           stringstream ss;
           ss << "mixin " << mixin[0].to_string() << " only takes " << params.size() << ((params.size() == 1) ? " argument" : " arguments");
-          throw_eval_error(ss.str(), args[i].path(), args[i].line());
+          throw_eval_error(ss.str(), args[i].file(), args[i].offset());
         }
         Node param(params[j]);
-        Token name(param.type() == Node::variable ? param.token() : param[0].token());
-        bindings[name] = eval(args[i], prefix, env, f_env, new_Node, ctx);
+        size_t slot = (param.type() == Node::variable ? param : param[0]).slot();
+        bindings.slots[slot] = eval(args[i], prefix, env, f_env, new_Node, ctx);
         ++j;
       }
     }
@@ -625,60 +1851,87 @@ namespace Sass {
     for (size_t i = 0, S = params.size(); i < S; ++i) {
       if (params[i].type() == Node::assignment) {
         Node param(params[i]);
-        Token name(param[0].token());
-        if (!bindings.query(name)) {
-          bindings[name] = eval(param[1], prefix, env, f_env, new_Node, ctx);
+        size_t slot = param[0].slot();
+        if (bindings.slots[slot].is_null_ptr()) {
+          bindings.slots[slot] = eval(param[1], prefix, env, f_env, new_Node, ctx);
         }
       }
     }
     // END ARG-BINDER
-    // link the new environment and eval the mixin's body
-    if (dynamic_scope) {
-      bindings.link(env);
+    // Rulesets get queued for @extend as they're evaluated, so documents
+    // with extensions don't get memoized expansions.
+    pair<size_t, string> key(mixin.slot(), prefix.to_string());
+    bool memoize = !ctx.has_extensions && is_pure_mixin(mixin, ctx);
+    for (size_t i = 0, S = params.size(); memoize && i < S; ++i) {
+      Node param(params[i].type() == Node::variable ? params[i] : params[i][0]);
+      Node val(bindings.slots[param.slot()]);
+      memoize = !val.is_null_ptr() && memo_key(val, key.second);
     }
-    else {
-      // C-style scope for now (current/global, nothing in between). May need
-      // to implement full lexical scope someday.
-      bindings.link(env.global ? *env.global : env);
+    if (memoize) {
+      map<pair<size_t, string>, Node>::iterator hit = ctx.expansions.find(key);
+      if (hit != ctx.expansions.end()) {
+        ++ctx.expansion_hits;
+        return hit->second;
+      }
+      ++ctx.expansion_misses;
     }
+    // link the new environment and eval the mixin's body
+    // C-style scope for now (current/global, nothing in between). May need
+    // to implement full lexical scope someday.
+    bindings.link(env.global ? *env.global : env);
     for (size_t i = 0, S = body.size(); i < S; ++i) {
-      body[i] = eval(body[i], prefix, bindings, f_env, new_Node, ctx);
+      set_child(body, i, eval(body[i], prefix, bindings, f_env, new_Node, ctx), new_Node);
+    }
+    if (memoize) {
+      if (ctx.expansions.size() >= Context::max_expansions) ctx.expansions.clear();
+      body.freeze();
+      ctx.expansions[key] = body;
     }
     return body;
   }
 
   // Apply a function -- bind the arguments and pass them to the underlying
   // primitive function implementation, then return its value.
-  
-  Node apply_function(const Function& f, const Node args, Node prefix, Environment& env, map<pair<string, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx)
+
+  Node apply_function(const Function& f, const Node args, Node prefix, Environment& env, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx)
   {
     if (f.primitive) {
-      map<Token, Node> bindings;
+      Node_List bindings;
+      bindings.reserve(f.parameters.size());
+      for (size_t i = 0, S = f.parameters.size(); i < S; ++i) bindings.push_back(Node());
       // bind arguments
       for (size_t i = 0, j = 0, S = args.size(); i < S; ++i) {
         if (args[i].type() == Node::assignment) {
           Node arg(args[i]);
-          Token name(arg[0].token());
-          bindings[name] = eval(arg[1], prefix, env, f_env, new_Node, ctx);
+          Node val(eval(arg[1], prefix, env, f_env, new_Node, ctx));
+          size_t k = f.parameter(arg[0].token());
+          if (k < bindings.size()) bindings[k] = val;
         }
         else {
           // TO DO: ensure (j < f.parameters.size())
-          bindings[f.parameters[j]] = eval(args[i], prefix, env, f_env, new_Node, ctx);
+          bindings[j] = eval(args[i], prefix, env, f_env, new_Node, ctx);
           ++j;
         }
       }
-      return f(bindings, new_Node);
+      try {
+        return f(bindings.begin(), new_Node);
+      }
+      catch (Error& e) {
+        locate_error(e, args);
+        throw;
+      }
     }
     else {
       Node params(f.definition[1]);
-      Node body(new_Node(f.definition[2]));
-      Environment bindings;
+      Node def_body(f.definition[2]);
+      Environment bindings(ctx.scopes[f.definition.slot()]);
       // TO DO: REFACTOR THE ARG-BINDER
       // bind arguments
       for (size_t i = 0, j = 0, S = args.size(); i < S; ++i) {
         if (args[i].type() == Node::assignment) {
           Node arg(args[i]);
           Token name(arg[0].token());
+          size_t slot = 0;
           // check that the keyword arg actually names a formal parameter
           bool valid_param = false;
           for (size_t k = 0, S = params.size(); k < S; ++k) {
@@ -686,12 +1939,13 @@ namespace Sass {
             if (param_k.type() == Node::assignment) param_k = param_k[0];
             if (arg[0] == param_k) {
               valid_param = true;
+              slot = param_k.slot();
               break;
             }
           }
-          if (!valid_param) throw_eval_error("mixin " + f.name + " has no parameter named " + name.to_string(), arg.path(), arg.line());
-          if (!bindings.query(name)) {
-            bindings[name] = eval(arg[1], prefix, env, f_env, new_Node, ctx);
+          if (!valid_param) throw_eval_error("mixin " + f.name + " has no parameter named " + name.to_string(), arg.file(), arg.offset());
+          if (bindings.slots[slot].is_null_ptr()) {
+            bindings.slots[slot] = eval(arg[1], prefix, env, f_env, new_Node, ctx);
           }
         }
         else {
@@ -699,11 +1953,11 @@ namespace Sass {
           if (j >= params.size()) {
             stringstream ss;
             ss << "mixin " << f.name << " only takes " << params.size() << ((params.size() == 1) ? " argument" : " arguments");
-            throw_eval_error(ss.str(), args[i].path(), args[i].line());
+            throw_eval_error(ss.str(), args[i].file(), args[i].offset());
           }
           Node param(params[j]);
-          Token name(param.type() == Node::variable ? param.token() : param[0].token());
-          bindings[name] = eval(args[i], prefix, env, f_env, new_Node, ctx);
+          size_t slot = (param.type() == Node::variable ? param : param[0]).slot();
+          bindings.slots[slot] = eval(args[i], prefix, env, f_env, new_Node, ctx);
           ++j;
         }
       }
@@ -711,16 +1965,59 @@ namespace Sass {
       for (size_t i = 0, S = params.size(); i < S; ++i) {
         if (params[i].type() == Node::assignment) {
           Node param(params[i]);
-          Token name(param[0].token());
-          if (!bindings.query(name)) {
-            bindings[name] = eval(param[1], prefix, env, f_env, new_Node, ctx);
+          size_t slot = param[0].slot();
+          if (bindings.slots[slot].is_null_ptr()) {
+            bindings.slots[slot] = eval(param[1], prefix, env, f_env, new_Node, ctx);
           }
         }
       }
       // END ARG-BINDER
+      // a parameter left unbound would be looked up globally, so those calls
+      // aren't memoized
+      pair<const Function*, string> key(&f, string());
+      bool memoize = is_pure(f, ctx);
+      for (size_t i = 0, S = params.size(); memoize && i < S; ++i) {
+        Node param(params[i].type() == Node::variable ? params[i] : params[i][0]);
+        Node val(bindings.slots[param.slot()]);
+        memoize = !val.is_null_ptr() && memo_key(val, key.second);
+      }
+      if (memoize) {
+        map<pair<const Function*, string>, Node>::iterator hit = ctx.memo.find(key);
+        if (hit != ctx.memo.end()) {
+          ++ctx.memo_hits;
+          return hit->second;
+        }
+        ++ctx.memo_misses;
+      }
+      Node body(def_body.is_shared() ? def_body : new_Node(def_body));
       bindings.link(env.global ? *env.global : env);
-      return function_eval(f.name, body, bindings, new_Node, ctx, true);
+      Node result(function_eval(f.name, body, bindings, new_Node, ctx, true));
+      string result_key;
+      if (memoize && memo_key(result, result_key)) {
+        // it's handed out again and again, so callers must copy it to change it
+        result.freeze();
+        ctx.memo[key] = result;
+      }
+      return result;
+    }
+  }
+
+  // Loops inside functions can run for a long time while only the return
+  // value survives, so each loop opens a Node_Factory scope and reclaims
+  // between iterations. Whatever the iterations allocated can only be
+  // reached from the loop statement itself (eval updates unshared nodes in
+  // place), the values bound in the environment chain, or `extra`.
+
+  static void reclaim(size_t scope, Node stm, Node extra, Environment& env, Node_Factory& new_Node)
+  {
+    if (!new_Node.should_collect(scope)) return;
+    vector<Node> roots;
+    roots.push_back(stm);
+    roots.push_back(extra);
+    for (Environment* frame = &env; frame; frame = frame->parent) {
+      roots.insert(roots.end(), frame->slots.begin(), frame->slots.end());
     }
+    new_Node.collect(scope, roots);
   }
 
   // Special function for evaluating pure Sass functions. The evaluation
@@ -730,30 +2027,20 @@ namespace Sass {
 
   Node function_eval(string name, Node body, Environment& bindings, Node_Factory& new_Node, Context& ctx, bool at_toplevel)
   {
+    Depth_Guard guard(body, ctx);
     for (size_t i = 0, S = body.size(); i < S; ++i) {
       Node stm(body[i]);
       switch (stm.type())
       {
         case Node::assignment: {
-          Node val(stm[1]);
-          if (val.type() == Node::comma_list || val.type() == Node::space_list) {
-            for (size_t i = 0, S = val.size(); i < S; ++i) {
-              if (val[i].should_eval()) val[i] = eval(val[i], Node(), bindings, ctx.function_env, new_Node, ctx);
-            }
-          }
-          else {
-            val = eval(val, Node(), bindings, ctx.function_env, new_Node, ctx);
-          }
+          Node val(assigned_value(stm[1], Node(), bindings, ctx.function_env, new_Node, ctx));
           Node var(stm[0]);
-          if (stm.is_guarded() && bindings.query(var.token())) continue;
+          if (stm.is_guarded() && bindings.lookup(var)) continue;
           // If a binding exists (possible upframe), then update it.
           // Otherwise, make a new on in the current frame.
-          if (bindings.query(var.token())) {
-            bindings[var.token()] = val;
-          }
-          else {
-            bindings.current_frame[var.token()] = val;
-          }
+          Node* binding = bindings.binding(var);
+          if (!binding) throw_eval_error("cannot assign to " + var.token().to_string() + " here", var.file(), var.offset());
+          assign(binding, val, new_Node, ctx);
         } break;
 
         case Node::if_directive: {
@@ -781,49 +2068,65 @@ namespace Sass {
           Node lower_bound(eval(stm[1], Node(), bindings, ctx.function_env, new_Node, ctx));
           Node upper_bound(eval(stm[2], Node(), bindings, ctx.function_env, new_Node, ctx));
           Node for_body(stm[3]);
-          Environment for_env; // re-use this env for each iteration
+          Environment for_env(ctx.scopes[stm.slot()]); // re-use this env for each iteration
           for_env.link(bindings);
+          size_t scope = new_Node.open_scope();
           for (double j = lower_bound.numeric_value(), T = upper_bound.numeric_value() + ((for_type == Node::for_to_directive) ? 0 : 1);
                j < T;
                j += 1) {
-            for_env.current_frame[iter_var.token()] = new_Node(lower_bound.path(), lower_bound.line(), j);
+            for_env.slots[iter_var.slot()] = new_Node(lower_bound.file(), lower_bound.offset(), j);
             Node v(function_eval(name, for_body, for_env, new_Node, ctx));
-            if (v.is_null_ptr()) continue;
-            else                 return v;
+            if (v.is_null_ptr()) {
+              reclaim(scope, stm, Node(), for_env, new_Node);
+              continue;
+            }
+            new_Node.close_scope();
+            return v;
           }
+          new_Node.close_scope();
         } break;
 
         case Node::each_directive: {
           Node iter_var(stm[0]);
           Node list(eval(stm[1], Node(), bindings, ctx.function_env, new_Node, ctx));
           if (list.type() != Node::comma_list && list.type() != Node::space_list) {
-            list = (new_Node(Node::space_list, list.path(), list.line(), 1) << list);
+            list = (new_Node(Node::space_list, list.file(), list.offset(), 1) << list);
           }
           Node each_body(stm[2]);
-          Environment each_env; // re-use this env for each iteration
+          Environment each_env(ctx.scopes[stm.slot()]); // re-use this env for each iteration
           each_env.link(bindings);
+          size_t scope = new_Node.open_scope();
           for (size_t j = 0, T = list.size(); j < T; ++j) {
-            each_env.current_frame[iter_var.token()] = eval(list[j], Node(), bindings, ctx.function_env, new_Node, ctx);
+            each_env.slots[iter_var.slot()] = eval(list[j], Node(), bindings, ctx.function_env, new_Node, ctx);
             Node v(function_eval(name, each_body, each_env, new_Node, ctx));
-            if (v.is_null_ptr()) continue;
-            else return v;
+            if (v.is_null_ptr()) {
+              reclaim(scope, stm, list, each_env, new_Node);
+              continue;
+            }
+            new_Node.close_scope();
+            return v;
           }
+          new_Node.close_scope();
         } break;
 
         case Node::while_directive: {
           Node pred_expr(stm[0]);
           Node while_body(stm[1]);
-          Environment while_env; // re-use this env for each iteration
+          Environment while_env(ctx.scopes[stm.slot()]); // re-use this env for each iteration
           while_env.link(bindings);
+          size_t scope = new_Node.open_scope();
           Node pred_val(eval(pred_expr, Node(), bindings, ctx.function_env, new_Node, ctx));
           while ((pred_val.type() != Node::boolean) || pred_val.boolean_value()) {
             Node v(function_eval(name, while_body, while_env, new_Node, ctx));
             if (v.is_null_ptr()) {
+              reclaim(scope, stm, Node(), while_env, new_Node);
               pred_val = eval(pred_expr, Node(), bindings, ctx.function_env, new_Node, ctx);
               continue;
             }
-            else return v;
+            new_Node.close_scope();
+            return v;
           }
+          new_Node.close_scope();
         } break;
 
         case Node::return_directive: {
@@ -835,7 +2138,7 @@ namespace Sass {
         } break;
       }
     }
-    if (at_toplevel) throw_eval_error("function finished without @return", body.path(), body.line());
+    if (at_toplevel) throw_eval_error("function finished without @return", body.file(), body.offset());
     return Node();
   }
 
@@ -851,7 +2154,7 @@ namespace Sass {
 
     if (sel.has_backref()) {
       if ((pre.type() == Node::selector_group) && (sel.type() == Node::selector_group)) {
-        Node group(new_Node(Node::selector_group, sel.path(), sel.line(), pre.size() * sel.size()));
+        Node group(new_Node(Node::selector_group, sel.file(), sel.offset(), pre.size() * sel.size()));
         for (size_t i = 0, S = pre.size(); i < S; ++i) {
           for (size_t j = 0, T = sel.size(); j < T; ++j) {
             group << expand_backref(new_Node(sel[j]), pre[i]);
@@ -860,14 +2163,14 @@ namespace Sass {
         return group;
       }
       else if ((pre.type() == Node::selector_group) && (sel.type() != Node::selector_group)) {
-        Node group(new_Node(Node::selector_group, sel.path(), sel.line(), pre.size()));
+        Node group(new_Node(Node::selector_group, sel.file(), sel.offset(), pre.size()));
         for (size_t i = 0, S = pre.size(); i < S; ++i) {
           group << expand_backref(new_Node(sel), pre[i]);
         }
         return group;
       }
       else if ((pre.type() != Node::selector_group) && (sel.type() == Node::selector_group)) {
-        Node group(new_Node(Node::selector_group, sel.path(), sel.line(), sel.size()));
+        Node group(new_Node(Node::selector_group, sel.file(), sel.offset(), sel.size()));
         for (size_t i = 0, S = sel.size(); i < S; ++i) {
           group << expand_backref(new_Node(sel[i]), pre);
         }
@@ -879,10 +2182,10 @@ namespace Sass {
     }
 
     if ((pre.type() == Node::selector_group) && (sel.type() == Node::selector_group)) {
-      Node group(new_Node(Node::selector_group, sel.path(), sel.line(), pre.size() * sel.size()));
+      Node group(new_Node(Node::selector_group, sel.file(), sel.offset(), pre.size() * sel.size()));
       for (size_t i = 0, S = pre.size(); i < S; ++i) {
         for (size_t j = 0, T = sel.size(); j < T; ++j) {
-          Node new_sel(new_Node(Node::selector, sel.path(), sel.line(), 2));
+          Node new_sel(new_Node(Node::selector, sel.file(), sel.offset(), 2));
           if (pre[i].type() == Node::selector) new_sel += pre[i];
           else                                 new_sel << pre[i];
           if (sel[j].type() == Node::selector) new_sel += sel[j];
@@ -893,9 +2196,9 @@ namespace Sass {
       return group;
     }
     else if ((pre.type() == Node::selector_group) && (sel.type() != Node::selector_group)) {
-      Node group(new_Node(Node::selector_group, sel.path(), sel.line(), pre.size()));
+      Node group(new_Node(Node::selector_group, sel.file(), sel.offset(), pre.size()));
       for (size_t i = 0, S = pre.size(); i < S; ++i) {
-        Node new_sel(new_Node(Node::selector, sel.path(), sel.line(), 2));
+        Node new_sel(new_Node(Node::selector, sel.file(), sel.offset(), 2));
         if (pre[i].type() == Node::selector) new_sel += pre[i];
         else                                 new_sel << pre[i];
         if (sel.type() == Node::selector)    new_sel += sel;
@@ -905,9 +2208,9 @@ namespace Sass {
       return group;
     }
     else if ((pre.type() != Node::selector_group) && (sel.type() == Node::selector_group)) {
-      Node group(new_Node(Node::selector_group, sel.path(), sel.line(), sel.size()));
+      Node group(new_Node(Node::selector_group, sel.file(), sel.offset(), sel.size()));
       for (size_t i = 0, S = sel.size(); i < S; ++i) {
-        Node new_sel(new_Node(Node::selector, sel.path(), sel.line(), 2));
+        Node new_sel(new_Node(Node::selector, sel.file(), sel.offset(), 2));
         if (pre.type() == Node::selector)    new_sel += pre;
         else                                 new_sel << pre;
         if (sel[i].type() == Node::selector) new_sel += sel[i];
@@ -917,7 +2220,7 @@ namespace Sass {
       return group;
     }
     else {
-      Node new_sel(new_Node(Node::selector, sel.path(), sel.line(), 2));
+      Node new_sel(new_Node(Node::selector, sel.file(), sel.offset(), 2));
       if (pre.type() == Node::selector) new_sel += pre;
       else                              new_sel << pre;
       if (sel.type() == Node::selector) new_sel += sel;
@@ -966,7 +2269,7 @@ namespace Sass {
 
       if (extendee.type() != Node::selector_group && !extendee.has_been_extended()) {
         Node extendee_base(selector_base(extendee));
-        Node extender_group(new_Node(Node::selector_group, extendee.path(), extendee.line(), 1));
+        Node extender_group(new_Node(Node::selector_group, extendee.file(), extendee.offset(), 1));
         for (multimap<Node, Node>::iterator i = extension_table.lower_bound(extendee_base), E = extension_table.upper_bound(extendee_base);
              i != E;
              ++i) {
@@ -975,7 +2278,7 @@ namespace Sass {
           else
             extender_group << i->second[2];
         }
-        Node extended_group(new_Node(Node::selector_group, extendee.path(), extendee.line(), extender_group.size() + 1));
+        Node extended_group(new_Node(Node::selector_group, extendee.file(), extendee.offset(), extender_group.size() + 1));
         extendee.has_been_extended() = true;
         extended_group << extendee;
         for (size_t i = 0, S = extender_group.size(); i < S; ++i) {
@@ -984,13 +2287,13 @@ namespace Sass {
         ruleset_to_extend[2] = extended_group;
       }
       else {
-        Node extended_group(new_Node(Node::selector_group, extendee.path(), extendee.line(), extendee.size() + 1));
+        Node extended_group(new_Node(Node::selector_group, extendee.file(), extendee.offset(), extendee.size() + 1));
         for (size_t i = 0, S = extendee.size(); i < S; ++i) {
           Node extendee_i(extendee[i]);
           Node extendee_i_base(selector_base(extendee_i));
           extended_group << extendee_i;
           if (!extendee_i.has_been_extended() && extension_table.count(extendee_i_base)) {
-            Node extender_group(new_Node(Node::selector_group, extendee.path(), extendee.line(), 1));
+            Node extender_group(new_Node(Node::selector_group, extendee.file(), extendee.offset(), 1));
             for (multimap<Node, Node>::iterator i = extension_table.lower_bound(extendee_i_base), E = extension_table.upper_bound(extendee_i_base);
                  i != E;
                  ++i) {
@@ -1015,7 +2318,7 @@ namespace Sass {
       // }
       // else if (extendee.type() == Node::selector_group && extender.type() != Node::selector_group) {
       //   cerr << "extending a group with a singleton!" << endl;
-      //   Node new_group(new_Node(Node::selector_group, extendee.path(), extendee.line(), extendee.size()));
+      //   Node new_group(new_Node(Node::selector_group, extendee.file(), extendee.offset(), extendee.size()));
       //   for (size_t i = 0, S = extendee.size(); i < S; ++i) {
       //     new_group << extendee[i];
       //     if (extension_table.count(extendee[i])) {
@@ -1039,8 +2342,8 @@ namespace Sass {
       // else {
       //   cerr << "possibly extending a selector in a group: " << selector_to_extend.to_string() << endl;
       //   Node new_group(new_Node(Node::selector_group,
-      //                  selector_to_extend.path(),
-      //                  selector_to_extend.line(),
+      //                  selector_to_extend.file(),
+      //                  selector_to_extend.offset(),
       //                  selector_to_extend.size()));
       //   for (size_t i = 0, S = selector_to_extend.size(); i < S; ++i) {
       //     Node sel_i(selector_to_extend[i]);
@@ -1072,7 +2375,7 @@ namespace Sass {
       //         selector_to_extend << extender;
       //       }
       //       else {
-      //         Node new_group(new_Node(Node::selector_group, selector_to_extend.path(), selector_to_extend.line(), 2));
+      //         Node new_group(new_Node(Node::selector_group, selector_to_extend.file(), selector_to_extend.offset(), 2));
       //         new_group << selector_to_extend << extender;
       //         ruleset_to_extend[2] = new_group;
       //       }
@@ -1094,15 +2397,15 @@ namespace Sass {
       //         selector_to_extend << new_ext;
       //       }
       //       else {
-      //         Node new_group(new_Node(Node::selector_group, selector_to_extend.path(), selector_to_extend.line(), 2));
+      //         Node new_group(new_Node(Node::selector_group, selector_to_extend.file(), selector_to_extend.offset(), 2));
       //         new_group << selector_to_extend << new_ext;
       //         ruleset_to_extend[2] = new_group;
       //       }
       //     } break;
 
       //     case Node::selector: {
-      //       Node new_ext1(new_Node(Node::selector, selector_to_extend.path(), selector_to_extend.line(), selector_to_extend.size() + extender.size() - 1));
-      //       Node new_ext2(new_Node(Node::selector, selector_to_extend.path(), selector_to_extend.line(), selector_to_extend.size() + extender.size() - 1));
+      //       Node new_ext1(new_Node(Node::selector, selector_to_extend.file(), selector_to_extend.offset(), selector_to_extend.size() + extender.size() - 1));
+      //       Node new_ext2(new_Node(Node::selector, selector_to_extend.file(), selector_to_extend.offset(), selector_to_extend.size() + extender.size() - 1));
       //       new_ext1 += selector_prefix(selector_to_extend, new_Node);
       //       new_ext1 += extender;
       //       new_ext2 += selector_prefix(extender, new_Node);
@@ -1112,7 +2415,7 @@ namespace Sass {
       //         selector_to_extend << new_ext1 << new_ext2;
       //       }
       //       else {
-      //         Node new_group(new_Node(Node::selector_group, selector_to_extend.path(), selector_to_extend.line(), 2));
+      //         Node new_group(new_Node(Node::selector_group, selector_to_extend.file(), selector_to_extend.offset(), 2));
       //         new_group << selector_to_extend << new_ext1 << new_ext2;
       //         ruleset_to_extend[2] = new_group;
       //       }
@@ -1131,7 +2434,7 @@ namespace Sass {
 
   Node generate_extension(Node extendee, Node extender, Node_Factory& new_Node)
   {
-    Node new_group(new_Node(Node::selector_group, extendee.path(), extendee.line(), 1));
+    Node new_group(new_Node(Node::selector_group, extendee.file(), extendee.offset(), 1));
     if (extendee.type() != Node::selector) {
       switch (extender.type())
       {
@@ -1154,7 +2457,7 @@ namespace Sass {
         case Node::simple_selector:
         case Node::attribute_selector:
         case Node::simple_selector_sequence: {
-          Node new_ext(new_Node(Node::selector, extendee.path(), extendee.line(), extendee.size()));
+          Node new_ext(new_Node(Node::selector, extendee.file(), extendee.offset(), extendee.size()));
           for (size_t i = 0, S = extendee.size() - 1; i < S; ++i) {
             new_ext << extendee[i];
           }
@@ -1164,8 +2467,8 @@ namespace Sass {
         } break;
 
         case Node::selector: {
-          Node new_ext1(new_Node(Node::selector, extendee.path(), extendee.line(), extendee.size() + extender.size() - 1));
-          Node new_ext2(new_Node(Node::selector, extendee.path(), extendee.line(), extendee.size() + extender.size() - 1));
+          Node new_ext1(new_Node(Node::selector, extendee.file(), extendee.offset(), extendee.size() + extender.size() - 1));
+          Node new_ext2(new_Node(Node::selector, extendee.file(), extendee.offset(), extendee.size() + extender.size() - 1));
           new_ext1 += selector_prefix(extendee, new_Node);
           new_ext1 += extender;
           new_ext2 += selector_prefix(extender, new_Node);
@@ -1192,7 +2495,7 @@ namespace Sass {
     switch (sel.type())
     {
       case Node::selector: {
-        Node pre(new_Node(Node::selector, sel.path(), sel.line(), sel.size() - 1));
+        Node pre(new_Node(Node::selector, sel.file(), sel.offset(), sel.size() - 1));
         for (size_t i = 0, S = sel.size() - 1; i < S; ++i) {
           pre << sel[i];
         }
@@ -1200,7 +2503,7 @@ namespace Sass {
       } break;
 
       default: {
-        return new_Node(Node::selector, sel.path(), sel.line(), 0);
+        return new_Node(Node::selector, sel.file(), sel.offset(), 0);
       } break;
     }
   }
@@ -1224,7 +2527,7 @@ namespace Sass {
     switch (sel.type())
     {
       case Node::selector: {
-        Node bf(new_Node(Node::selector, sel.path(), sel.line(), sel.size() - 1));
+        Node bf(new_Node(Node::selector, sel.file(), sel.offset(), sel.size() - 1));
         for (size_t i = start, S = sel.size() - from_end; i < S; ++i) {
           bf << sel[i];
         }
@@ -1232,7 +2535,7 @@ namespace Sass {
       } break;
 
       default: {
-        return new_Node(Node::selector, sel.path(), sel.line(), 0);
+        return new_Node(Node::selector, sel.file(), sel.offset(), 0);
       } break;
     }
   }
@@ -11,13 +11,17 @@
 namespace Sass {
   using std::map;
   
-  Node eval(Node expr, Node prefix, Environment& env, map<pair<string, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx);
+  void resolve(Node root, Context& ctx);
+  void prune(Node root, Context& ctx);
+  void fold(Node root, Context& ctx);
+  void compile(Node root, Context& ctx);
+  Node eval(Node expr, Node prefix, Environment& env, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx);
   Node function_eval(string name, Node stm, Environment& bindings, Node_Factory& new_Node, Context& ctx, bool toplevel = false);
   Node accumulate(Node::Type op, Node acc, Node rhs, Node_Factory& new_Node);
   double operate(Node::Type op, double lhs, double rhs);
   
-  Node apply_mixin(Node mixin, const Node args, Node prefix, Environment& env, map<pair<string, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx, bool dynamic_scope = false);
-  Node apply_function(const Function& f, const Node args, Node prefix, Environment& env, map<pair<string, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx);
+  Node apply_mixin(Node mixin, const Node args, Node prefix, Environment& env, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx);
+  Node apply_function(const Function& f, const Node args, Node prefix, Environment& env, map<pair<size_t, size_t>, Function>& f_env, Node_Factory& new_Node, Context& ctx);
   Node expand_selector(Node sel, Node pre, Node_Factory& new_Node);
   Node expand_backref(Node sel, Node pre);
   void extend_selectors(vector<pair<Node, Node> >&, multimap<Node, Node>&, Node_Factory&);
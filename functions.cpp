@@ -11,80 +11,75 @@ using std::cerr; using std::endl;
 namespace Sass {
   namespace Functions {
 
-    static void throw_eval_error(string message, string path, size_t line)
-    {
-      if (!path.empty() && Prelexer::string_constant(path.c_str()))
-        path = path.substr(1, path.length() - 1);
-
-      throw Error(Error::evaluation, path, line, message);
-    }
+    static void throw_eval_error(string message, size_t file, size_t offset)
+    { throw Error(Error::evaluation, file, offset, message); }
 
     // RGB Functions ///////////////////////////////////////////////////////
 
     Function_Descriptor rgb_descriptor = 
     { "rgb", "$red", "$green", "$blue", 0 };
-    Node rgb(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node r(bindings[parameters[0]]);
-      Node g(bindings[parameters[1]]);
-      Node b(bindings[parameters[2]]);
+    Node rgb(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node r(args[0]);
+      Node g(args[1]);
+      Node b(args[2]);
       if (!(r.type() == Node::number && g.type() == Node::number && b.type() == Node::number)) {
-        throw_eval_error("arguments for rgb must be numbers", r.path(), r.line());
+        throw_eval_error("arguments for rgb must be numbers", r.file(), r.offset());
       }
-      return new_Node(r.path(), r.line(), r.numeric_value(), g.numeric_value(), b.numeric_value(), 1.0);
+      return new_Node(r.file(), r.offset(), r.numeric_value(), g.numeric_value(), b.numeric_value(), 1.0);
     }
 
     Function_Descriptor rgba_4_descriptor = 
     { "rgba", "$red", "$green", "$blue", "$alpha", 0 };
-    Node rgba_4(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node r(bindings[parameters[0]]);
-      Node g(bindings[parameters[1]]);
-      Node b(bindings[parameters[2]]);
-      Node a(bindings[parameters[3]]);
+    Node rgba_4(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node r(args[0]);
+      Node g(args[1]);
+      Node b(args[2]);
+      Node a(args[3]);
       if (!(r.type() == Node::number && g.type() == Node::number && b.type() == Node::number && a.type() == Node::number)) {
-        throw_eval_error("arguments for rgba must be numbers", r.path(), r.line());
+        throw_eval_error("arguments for rgba must be numbers", r.file(), r.offset());
       }
-      return new_Node(r.path(), r.line(), r.numeric_value(), g.numeric_value(), b.numeric_value(), a.numeric_value());
+      return new_Node(r.file(), r.offset(), r.numeric_value(), g.numeric_value(), b.numeric_value(), a.numeric_value());
     }
     
     Function_Descriptor rgba_2_descriptor = 
     { "rgba", "$color", "$alpha", 0 };
-    Node rgba_2(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node color(bindings[parameters[0]]);
+    Node rgba_2(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node color(args[0]);
       Node r(color[0]);
       Node g(color[1]);
       Node b(color[2]);
-      Node a(bindings[parameters[1]]);
-      if (color.type() != Node::numeric_color || a.type() != Node::number) throw_eval_error("arguments to rgba must be a color and a number", color.path(), color.line());
-      return new_Node(color.path(), color.line(), r.numeric_value(), g.numeric_value(), b.numeric_value(), a.numeric_value());
+      Node a(args[1]);
+      if (color.type() != Node::numeric_color || a.type() != Node::number) throw_eval_error("arguments to rgba must be a color and a number", color.file(), color.offset());
+      return new_Node(color.file(), color.offset(), r.numeric_value(), g.numeric_value(), b.numeric_value(), a.numeric_value());
     }
     
     Function_Descriptor red_descriptor =
     { "red", "$color", 0 };
-    Node red(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node color(bindings[parameters[0]]);
-      if (color.type() != Node::numeric_color) throw_eval_error("argument to red must be a color", color.path(), color.line());
+    Node red(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node color(args[0]);
+      if (color.type() != Node::numeric_color) throw_eval_error("argument to red must be a color", color.file(), color.offset());
       return color[0];
     }
     
     Function_Descriptor green_descriptor =
     { "green", "$color", 0 };
-    Node green(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node color(bindings[parameters[0]]);
-      if (color.type() != Node::numeric_color) throw_eval_error("argument to green must be a color", color.path(), color.line());
+    Node green(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node color(args[0]);
+      if (color.type() != Node::numeric_color) throw_eval_error("argument to green must be a color", color.file(), color.offset());
       return color[1];
     }
     
     Function_Descriptor blue_descriptor =
     { "blue", "$color", 0 };
-    Node blue(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node color(bindings[parameters[0]]);
-      if (color.type() != Node::numeric_color) throw_eval_error("argument to blue must be a color", color.path(), color.line());
+    Node blue(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node color(args[0]);
+      if (color.type() != Node::numeric_color) throw_eval_error("argument to blue must be a color", color.file(), color.offset());
       return color[2];
     }
     
     Node mix_impl(Node color1, Node color2, double weight, Node_Factory& new_Node) {
       if (!(color1.type() == Node::numeric_color && color2.type() == Node::numeric_color)) {
-        throw_eval_error("first two arguments to mix must be colors", color1.path(), color1.line());
+        throw_eval_error("first two arguments to mix must be colors", color1.file(), color1.offset());
       }
       double p = weight/100;
       double w = 2*p - 1;
@@ -93,31 +88,31 @@ namespace Sass {
       double w1 = (((w * a == -1) ? w : (w + a)/(1 + w*a)) + 1)/2.0;
       double w2 = 1 - w1;
       
-      Node mixed(new_Node(Node::numeric_color, color1.path(), color1.line(), 4));
+      Node mixed(new_Node(Node::numeric_color, color1.file(), color1.offset(), 4));
       for (int i = 0; i < 3; ++i) {
-        mixed << new_Node(mixed.path(), mixed.line(),
+        mixed << new_Node(mixed.file(), mixed.offset(),
                           w1*color1[i].numeric_value() + w2*color2[i].numeric_value());
       }
       double alpha = color1[3].numeric_value()*p + color2[3].numeric_value()*(1-p);
-      mixed << new_Node(mixed.path(), mixed.line(), alpha);
+      mixed << new_Node(mixed.file(), mixed.offset(), alpha);
       return mixed;
     }
     
     Function_Descriptor mix_2_descriptor =
     { "mix", "$color1", "$color2", 0 };
-    Node mix_2(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      return mix_impl(bindings[parameters[0]], bindings[parameters[1]], 50, new_Node);
+    Node mix_2(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      return mix_impl(args[0], args[1], 50, new_Node);
     }
     
     Function_Descriptor mix_3_descriptor =
     { "mix", "$color1", "$color2", "$weight", 0 };
-    Node mix_3(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node percentage(bindings[parameters[2]]);
+    Node mix_3(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node percentage(args[2]);
       if (!(percentage.type() == Node::number || percentage.type() == Node::numeric_percentage || percentage.type() == Node::numeric_dimension)) {
-        throw_eval_error("third argument to mix must be numeric", percentage.path(), percentage.line());
+        throw_eval_error("third argument to mix must be numeric", percentage.file(), percentage.offset());
       }
-      return mix_impl(bindings[parameters[0]],
-                      bindings[parameters[1]],
+      return mix_impl(args[0],
+                      args[1],
                       percentage.numeric_value(),
                       new_Node);
     }
@@ -146,49 +141,49 @@ namespace Sass {
       double g = h_to_rgb(m1, m2, h) * 255.0;
       double b = h_to_rgb(m1, m2, h-1.0/3.0) * 255.0;
       
-      return new_Node("", 0, r, g, b, a);
+      return new_Node(0, 0, r, g, b, a);
     }
 
     Function_Descriptor hsla_descriptor =
     { "hsla", "$hue", "$saturation", "$lightness", "$alpha", 0 };
-    Node hsla(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      if (!(bindings[parameters[0]].is_numeric() &&
-            bindings[parameters[1]].is_numeric() &&
-            bindings[parameters[2]].is_numeric() &&
-            bindings[parameters[3]].is_numeric())) {
-        throw_eval_error("arguments to hsla must be numeric", bindings[parameters[0]].path(), bindings[parameters[0]].line());
+    Node hsla(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      if (!(args[0].is_numeric() &&
+            args[1].is_numeric() &&
+            args[2].is_numeric() &&
+            args[3].is_numeric())) {
+        throw_eval_error("arguments to hsla must be numeric", args[0].file(), args[0].offset());
       }  
-      double h = bindings[parameters[0]].numeric_value();
-      double s = bindings[parameters[1]].numeric_value();
-      double l = bindings[parameters[2]].numeric_value();
-      double a = bindings[parameters[3]].numeric_value();
+      double h = args[0].numeric_value();
+      double s = args[1].numeric_value();
+      double l = args[2].numeric_value();
+      double a = args[3].numeric_value();
       Node color(hsla_impl(h, s, l, a, new_Node));
-      // color.line() = bindings[parameters[0]].line();
+      // color.offset() = args[0].offset();
       return color;
     }
     
     Function_Descriptor hsl_descriptor =
     { "hsl", "$hue", "$saturation", "$lightness", 0 };
-    Node hsl(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      if (!(bindings[parameters[0]].is_numeric() &&
-            bindings[parameters[1]].is_numeric() &&
-            bindings[parameters[2]].is_numeric())) {
-        throw_eval_error("arguments to hsl must be numeric", bindings[parameters[0]].path(), bindings[parameters[0]].line());
+    Node hsl(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      if (!(args[0].is_numeric() &&
+            args[1].is_numeric() &&
+            args[2].is_numeric())) {
+        throw_eval_error("arguments to hsl must be numeric", args[0].file(), args[0].offset());
       }  
-      double h = bindings[parameters[0]].numeric_value();
-      double s = bindings[parameters[1]].numeric_value();
-      double l = bindings[parameters[2]].numeric_value();
+      double h = args[0].numeric_value();
+      double s = args[1].numeric_value();
+      double l = args[2].numeric_value();
       Node color(hsla_impl(h, s, l, 1, new_Node));
-      // color.line() = bindings[parameters[0]].line();
+      // color.offset() = args[0].offset();
       return color;
     }
     
     Function_Descriptor invert_descriptor =
     { "invert", "$color", 0 };
-    Node invert(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node orig(bindings[parameters[0]]);
-      if (orig.type() != Node::numeric_color) throw_eval_error("argument to invert must be a color", orig.path(), orig.line());
-      return new_Node(orig.path(), orig.line(),
+    Node invert(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node orig(args[0]);
+      if (orig.type() != Node::numeric_color) throw_eval_error("argument to invert must be a color", orig.file(), orig.offset());
+      return new_Node(orig.file(), orig.offset(),
                       255 - orig[0].numeric_value(),
                       255 - orig[1].numeric_value(),
                       255 - orig[2].numeric_value(),
@@ -201,9 +196,9 @@ namespace Sass {
     { "alpha", "$color", 0 };
     Function_Descriptor opacity_descriptor =
     { "opacity", "$color", 0 };
-    Node alpha(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node color(bindings[parameters[0]]);
-      if (color.type() != Node::numeric_color) throw_eval_error("argument to alpha must be a color", color.path(), color.line());
+    Node alpha(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node color(args[0]);
+      if (color.type() != Node::numeric_color) throw_eval_error("argument to alpha must be a color", color.file(), color.offset());
       return color[3];
     }
     
@@ -211,19 +206,19 @@ namespace Sass {
     { "opacify", "$color", "$amount", 0 };
     Function_Descriptor fade_in_descriptor =
     { "fade_in", "$color", "$amount", 0 };
-    Node opacify(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node color(bindings[parameters[0]]);
-      Node delta(bindings[parameters[1]]);
+    Node opacify(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node color(args[0]);
+      Node delta(args[1]);
       if (color.type() != Node::numeric_color || !delta.is_numeric()) {
-        throw_eval_error("arguments to opacify/fade_in must be a color and a numeric value", color.path(), color.line());
+        throw_eval_error("arguments to opacify/fade_in must be a color and a numeric value", color.file(), color.offset());
       }
       if (delta.numeric_value() < 0 || delta.numeric_value() > 1) {
-        throw_eval_error("amount must be between 0 and 1 for opacify/fade-in", delta.path(), delta.line());
+        throw_eval_error("amount must be between 0 and 1 for opacify/fade-in", delta.file(), delta.offset());
       }
       double alpha = color[3].numeric_value() + delta.numeric_value();
       if (alpha > 1) alpha = 1;
       else if (alpha < 0) alpha = 0;
-      return new_Node(color.path(), color.line(),
+      return new_Node(color.file(), color.offset(),
                       color[0].numeric_value(), color[1].numeric_value(), color[2].numeric_value(), alpha);
     }
     
@@ -231,19 +226,19 @@ namespace Sass {
     { "transparentize", "$color", "$amount", 0 };
     Function_Descriptor fade_out_descriptor =
     { "fade_out", "$color", "$amount", 0 };
-    Node transparentize(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node color(bindings[parameters[0]]);
-      Node delta(bindings[parameters[1]]);
+    Node transparentize(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node color(args[0]);
+      Node delta(args[1]);
       if (color.type() != Node::numeric_color || !delta.is_numeric()) {
-        throw_eval_error("arguments to transparentize/fade_out must be a color and a numeric value", color.path(), color.line());
+        throw_eval_error("arguments to transparentize/fade_out must be a color and a numeric value", color.file(), color.offset());
       }
       if (delta.numeric_value() < 0 || delta.numeric_value() > 1) {
-        throw_eval_error("amount must be between 0 and 1 for transparentize/fade-out", delta.path(), delta.line());
+        throw_eval_error("amount must be between 0 and 1 for transparentize/fade-out", delta.file(), delta.offset());
       }
       double alpha = color[3].numeric_value() - delta.numeric_value();
       if (alpha > 1) alpha = 1;
       else if (alpha < 0) alpha = 0;
-      return new_Node(color.path(), color.line(),
+      return new_Node(color.file(), color.offset(),
                       color[0].numeric_value(), color[1].numeric_value(), color[2].numeric_value(), alpha);
     }
       
@@ -251,10 +246,10 @@ namespace Sass {
     
     Function_Descriptor unquote_descriptor =
     { "unquote", "$string", 0 };
-    Node unquote(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node cpy(new_Node(bindings[parameters[0]]));
+    Node unquote(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node cpy(new_Node(args[0]));
       // if (cpy.type() != Node::string_constant /* && cpy.type() != Node::concatenation */) {
-      //   throw_eval_error("argument to unquote must be a string", cpy.path(), cpy.line());
+      //   throw_eval_error("argument to unquote must be a string", cpy.file(), cpy.offset());
       // }
       cpy.is_unquoted() = true;
       cpy.is_quoted() = false;
@@ -263,12 +258,12 @@ namespace Sass {
     
     Function_Descriptor quote_descriptor =
     { "quote", "$string", 0 };
-    Node quote(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node orig(bindings[parameters[0]]);
+    Node quote(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node orig(args[0]);
       switch (orig.type())
       {
         default: {
-          throw_eval_error("argument to quote must be a string or identifier", orig.path(), orig.line());
+          throw_eval_error("argument to quote must be a string or identifier", orig.file(), orig.offset());
         } break;
 
         case Node::string_constant:
@@ -289,38 +284,38 @@ namespace Sass {
     
     Function_Descriptor percentage_descriptor =
     { "percentage", "$value", 0 };
-    Node percentage(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node orig(bindings[parameters[0]]);
+    Node percentage(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node orig(args[0]);
       if (orig.type() != Node::number) {
-        throw_eval_error("argument to percentage must be a unitless number", orig.path(), orig.line());
+        throw_eval_error("argument to percentage must be a unitless number", orig.file(), orig.offset());
       }
-      return new_Node(orig.path(), orig.line(), orig.numeric_value() * 100, Node::numeric_percentage);
+      return new_Node(orig.file(), orig.offset(), orig.numeric_value() * 100, Node::numeric_percentage);
     }
 
     Function_Descriptor round_descriptor =
     { "round", "$value", 0 };
-    Node round(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node orig(bindings[parameters[0]]);
+    Node round(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node orig(args[0]);
       switch (orig.type())
       {
         case Node::numeric_dimension: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::floor(orig.numeric_value() + 0.5), orig.unit());
         } break;
 
         case Node::number: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::floor(orig.numeric_value() + 0.5));
         } break;
 
         case Node::numeric_percentage: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::floor(orig.numeric_value() + 0.5),
                           Node::numeric_percentage);
         } break;
 
         default: {
-          throw_eval_error("argument to round must be numeric", orig.path(), orig.line());
+          throw_eval_error("argument to round must be numeric", orig.file(), orig.offset());
         } break;
       }
       // unreachable statement
@@ -329,28 +324,28 @@ namespace Sass {
 
     Function_Descriptor ceil_descriptor =
     { "ceil", "$value", 0 };
-    Node ceil(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node orig(bindings[parameters[0]]);
+    Node ceil(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node orig(args[0]);
       switch (orig.type())
       {
         case Node::numeric_dimension: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::ceil(orig.numeric_value()), orig.unit());
         } break;
 
         case Node::number: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::ceil(orig.numeric_value()));
         } break;
 
         case Node::numeric_percentage: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::ceil(orig.numeric_value()),
                           Node::numeric_percentage);
         } break;
 
         default: {
-          throw_eval_error("argument to ceil must be numeric", orig.path(), orig.line());
+          throw_eval_error("argument to ceil must be numeric", orig.file(), orig.offset());
         } break;
       }
       // unreachable statement
@@ -359,28 +354,28 @@ namespace Sass {
 
     Function_Descriptor floor_descriptor =
     { "floor", "$value", 0 };
-    Node floor(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node orig(bindings[parameters[0]]);
+    Node floor(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node orig(args[0]);
       switch (orig.type())
       {
         case Node::numeric_dimension: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::floor(orig.numeric_value()), orig.unit());
         } break;
 
         case Node::number: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::floor(orig.numeric_value()));
         } break;
 
         case Node::numeric_percentage: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::floor(orig.numeric_value()),
                           Node::numeric_percentage);
         } break;
 
         default: {
-          throw_eval_error("argument to floor must be numeric", orig.path(), orig.line());
+          throw_eval_error("argument to floor must be numeric", orig.file(), orig.offset());
         } break;
       }
       // unreachable statement
@@ -389,28 +384,28 @@ namespace Sass {
 
     Function_Descriptor abs_descriptor =
     { "abs", "$value", 0 };
-    Node abs(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node orig(bindings[parameters[0]]);
+    Node abs(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node orig(args[0]);
       switch (orig.type())
       {
         case Node::numeric_dimension: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::abs(orig.numeric_value()), orig.unit());
         } break;
 
         case Node::number: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::abs(orig.numeric_value()));
         } break;
 
         case Node::numeric_percentage: {
-          return new_Node(orig.path(), orig.line(),
+          return new_Node(orig.file(), orig.offset(),
                           std::abs(orig.numeric_value()),
                           Node::numeric_percentage);
         } break;
 
         default: {
-          throw_eval_error("argument to abs must be numeric", orig.path(), orig.line());
+          throw_eval_error("argument to abs must be numeric", orig.file(), orig.offset());
         } break;
       }
       // unreachable statement
@@ -421,22 +416,22 @@ namespace Sass {
 
     Function_Descriptor length_descriptor =
     { "length", "$list", 0 };
-    Node length(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node arg(bindings[parameters[0]]);
+    Node length(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node arg(args[0]);
       switch (arg.type())
       {
         case Node::space_list:
         case Node::comma_list: {
-          return new_Node(arg.path(), arg.line(), arg.size());
+          return new_Node(arg.file(), arg.offset(), arg.size());
         } break;
 
         case Node::nil: {
-          return new_Node(arg.path(), arg.line(), 0);
+          return new_Node(arg.file(), arg.offset(), 0);
         } break;
 
         default: {
           // single objects should be reported as lists of length 1
-          return new_Node(arg.path(), arg.line(), 1);
+          return new_Node(arg.file(), arg.offset(), 1);
         } break;
       }
       // unreachable statement
@@ -445,40 +440,40 @@ namespace Sass {
     
     Function_Descriptor nth_descriptor =
     { "nth", "$list", "$n", 0 };
-    Node nth(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node l(bindings[parameters[0]]);
-      Node n(bindings[parameters[1]]);
+    Node nth(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node l(args[0]);
+      Node n(args[1]);
       if (n.type() != Node::number) {
-        throw_eval_error("second argument to nth must be a number", n.path(), n.line());
+        throw_eval_error("second argument to nth must be a number", n.file(), n.offset());
       }
       if (l.type() == Node::nil) {
-        throw_eval_error("cannot index into an empty list", l.path(), l.line());
+        throw_eval_error("cannot index into an empty list", l.file(), l.offset());
       }
       // wrap the first arg if it isn't a list
       if (l.type() != Node::space_list && l.type() != Node::comma_list) {
-        l = new_Node(Node::space_list, l.path(), l.line(), 1) << l;
+        l = new_Node(Node::space_list, l.file(), l.offset(), 1) << l;
       }
       double n_prim = n.numeric_value();
       if (n_prim < 1 || n_prim > l.size()) {
-        throw_eval_error("out of range index for nth", n.path(), n.line());
+        throw_eval_error("out of range index for nth", n.file(), n.offset());
       }
       return l[n_prim - 1];
     }
     
     extern const char separator_kwd[] = "$separator";
-    Node join_impl(const vector<Token>& parameters, map<Token, Node>& bindings, bool has_sep, Node_Factory& new_Node) {
+    Node join_impl(const vector<Token>& parameters, Node args[], bool has_sep, Node_Factory& new_Node) {
       // if the args aren't lists, turn them into singleton lists
-      Node l1(bindings[parameters[0]]);
+      Node l1(args[0]);
       if (l1.type() != Node::space_list && l1.type() != Node::comma_list && l1.type() != Node::nil) {
-        l1 = new_Node(Node::space_list, l1.path(), l1.line(), 1) << l1;
+        l1 = new_Node(Node::space_list, l1.file(), l1.offset(), 1) << l1;
       }
-      Node l2(bindings[parameters[1]]);
+      Node l2(args[1]);
       if (l2.type() != Node::space_list && l2.type() != Node::comma_list && l2.type() != Node::nil) {
-        l2 = new_Node(Node::space_list, l2.path(), l2.line(), 1) << l2;
+        l2 = new_Node(Node::space_list, l2.file(), l2.offset(), 1) << l2;
       }
       // nil + nil = nil
       if (l1.type() == Node::nil && l2.type() == Node::nil) {
-        return new_Node(Node::nil, l1.path(), l1.line(), 0);
+        return new_Node.nil();
       }
       // figure out the combined size in advance
       size_t size = 0;
@@ -487,18 +482,18 @@ namespace Sass {
       // figure out the result type in advance
       Node::Type rtype = Node::space_list;
       if (has_sep) {
-        string sep(bindings[parameters[2]].token().unquote());
+        string sep(args[2].token().unquote());
         if (sep == "comma")      rtype = Node::comma_list;
         else if (sep == "space") rtype = Node::space_list;
         else if (sep == "auto")  rtype = l1.type();
         else {
-          throw_eval_error("third argument to join must be 'space', 'comma', or 'auto'", l2.path(), l2.line());
+          throw_eval_error("third argument to join must be 'space', 'comma', or 'auto'", l2.file(), l2.offset());
         }
       }
       else if (l1.type() != Node::nil) rtype = l1.type();
       else if (l2.type() != Node::nil) rtype = l2.type();
       // accumulate the result
-      Node lr(new_Node(rtype, l1.path(), l1.line(), size));
+      Node lr(new_Node(rtype, l1.file(), l1.offset(), size));
       if (l1.type() != Node::nil) lr += l1;
       if (l2.type() != Node::nil) lr += l2;
       return lr;
@@ -506,18 +501,18 @@ namespace Sass {
     
     Function_Descriptor join_2_descriptor =
     { "join", "$list1", "$list2", 0 };
-    Node join_2(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      return join_impl(parameters, bindings, false, new_Node);
+    Node join_2(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      return join_impl(parameters, args, false, new_Node);
     }
     
     Function_Descriptor join_3_descriptor =
     { "join", "$list1", "$list2", "$separator", 0 };
-    Node join_3(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      return join_impl(parameters, bindings, true, new_Node);
+    Node join_3(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      return join_impl(parameters, args, true, new_Node);
     }
 
-    Node append_impl(const vector<Token>& parameters, map<Token, Node>& bindings, bool has_sep, Node_Factory& new_Node) {
-      Node list(bindings[parameters[0]]);
+    Node append_impl(const vector<Token>& parameters, Node args[], bool has_sep, Node_Factory& new_Node) {
+      Node list(args[0]);
       switch (list.type())
       {
         case Node::space_list:
@@ -527,59 +522,59 @@ namespace Sass {
         } break;
         // if the first arg isn't a list, wrap it in a singleton
         default: {
-          list = (new_Node(Node::space_list, list.path(), list.line(), 1) << list);
+          list = (new_Node(Node::space_list, list.file(), list.offset(), 1) << list);
         } break;
       }
       Node::Type sep_type = list.type();
       if (has_sep) {
-        string sep_string = bindings[parameters[2]].token().unquote();
+        string sep_string = args[2].token().unquote();
         if (sep_string == "comma")      sep_type = Node::comma_list;
         else if (sep_string == "space") sep_type = Node::space_list;
         else if (sep_string == "auto")  sep_type = list.type();
-        else throw_eval_error("third argument to append must be 'space', 'comma', or 'auto'", list.path(), list.line());
+        else throw_eval_error("third argument to append must be 'space', 'comma', or 'auto'", list.file(), list.offset());
       }
-      Node new_list(new_Node(sep_type, list.path(), list.line(), list.size() + 1));
+      Node new_list(new_Node(sep_type, list.file(), list.offset(), list.size() + 1));
       new_list += list;
-      new_list << bindings[parameters[1]];
+      new_list << args[1];
       return new_list;
     }
 
     Function_Descriptor append_2_descriptor =
     { "append", "$list", "$val", 0 };
-    Node append_2(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      return append_impl(parameters, bindings, false, new_Node);
+    Node append_2(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      return append_impl(parameters, args, false, new_Node);
     }
 
     Function_Descriptor append_3_descriptor =
     { "append", "$list", "$val", "$separator", 0 };
-    Node append_3(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      return append_impl(parameters, bindings, true, new_Node);
+    Node append_3(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      return append_impl(parameters, args, true, new_Node);
     }
 
-    Node compact(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      size_t num_args     = bindings.size();
+    Node compact(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      size_t num_args     = parameters.size();
       Node::Type sep_type = Node::comma_list;
       Node list;
-      Node arg1(bindings[parameters[0]]);
+      Node arg1(args[0]);
       if (num_args == 1 && (arg1.type() == Node::space_list ||
                             arg1.type() == Node::comma_list ||
                             arg1.type() == Node::nil)) {
-        list = new_Node(arg1.type(), arg1.path(), arg1.line(), arg1.size());
+        list = new_Node(arg1.type(), arg1.file(), arg1.offset(), arg1.size());
         list += arg1;
       }
       else {
-        list = new_Node(sep_type, arg1.path(), arg1.line(), num_args);
+        list = new_Node(sep_type, arg1.file(), arg1.offset(), num_args);
         for (size_t i = 0; i < num_args; ++i) {
-          list << bindings[parameters[i]];
+          list << args[i];
         }
       }
-      Node new_list(new_Node(list.type(), list.path(), list.line(), 0));
+      Node new_list(new_Node(list.type(), list.file(), list.offset(), 0));
       for (size_t i = 0, S = list.size(); i < S; ++i) {
         if ((list[i].type() != Node::boolean) || list[i].boolean_value()) {
           new_list << list[i];
         }
       }
-      return new_list.size() ? new_list : new_Node(Node::nil, list.path(), list.line(), 0);
+      return new_list.size() ? new_list : new_Node.nil();
     }
 
     Function_Descriptor compact_1_descriptor =
@@ -619,8 +614,8 @@ namespace Sass {
     
     Function_Descriptor type_of_descriptor =
     { "type-of", "$value", 0 };
-    Node type_of(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node val(bindings[parameters[0]]);
+    Node type_of(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node val(args[0]);
       Token type_name;
       switch (val.type())
       {
@@ -648,7 +643,7 @@ namespace Sass {
           type_name = Token::make(string_name);
         } break;
       }
-      Node type(new_Node(Node::string_constant, val.path(), val.line(), type_name));
+      Node type(new_Node(Node::string_constant, val.file(), val.offset(), type_name));
       type.is_unquoted() = true;
       return type;
     }
@@ -658,21 +653,21 @@ namespace Sass {
     
     Function_Descriptor unit_descriptor =
     { "unit", "$number", 0 };
-    Node unit(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node val(bindings[parameters[0]]);
+    Node unit(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node val(args[0]);
       switch (val.type())
       {
         case Node::number: {
-          return new_Node(Node::string_constant, val.path(), val.line(), Token::make(empty_str));
+          return new_Node(Node::string_constant, val.file(), val.offset(), Token::make(empty_str));
         } break;
 
         case Node::numeric_dimension:
         case Node::numeric_percentage: {
-          return new_Node(Node::string_constant, val.path(), val.line(), val.unit());
+          return new_Node(Node::string_constant, val.file(), val.offset(), val.unit());
         } break;
 
         default: {
-          throw_eval_error("argument to unit must be numeric", val.path(), val.line());
+          throw_eval_error("argument to unit must be numeric", val.file(), val.offset());
         } break;
       }
       // unreachable statement
@@ -684,21 +679,21 @@ namespace Sass {
 
     Function_Descriptor unitless_descriptor =
     { "unitless", "$number", 0 };
-    Node unitless(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node val(bindings[parameters[0]]);
+    Node unitless(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node val(args[0]);
       switch (val.type())
       {
         case Node::number: {
-          return new_Node(Node::boolean, val.path(), val.line(), true);
+          return new_Node.boolean(true);
         } break;
 
         case Node::numeric_percentage:
         case Node::numeric_dimension: {
-          return new_Node(Node::boolean, val.path(), val.line(), false);
+          return new_Node.boolean(false);
         } break;
 
         default: {
-          throw_eval_error("argument to unitless must be numeric", val.path(), val.line());
+          throw_eval_error("argument to unitless must be numeric", val.file(), val.offset());
         } break;
       }
       // unreachable statement
@@ -707,58 +702,48 @@ namespace Sass {
     
     Function_Descriptor comparable_descriptor =
     { "comparable", "$number_1", "$number_2", 0 };
-    Node comparable(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node n1(bindings[parameters[0]]);
-      Node n2(bindings[parameters[1]]);
+    Node comparable(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node n1(args[0]);
+      Node n2(args[1]);
       Node::Type t1 = n1.type();
       Node::Type t2 = n2.type();
       if ((t1 == Node::number && n2.is_numeric()) ||
           (n1.is_numeric() && t2 == Node::number)) {
-        return new_Node(Node::boolean, n1.path(), n1.line(), true);
+        return new_Node.boolean(true);
       }
       else if (t1 == Node::numeric_percentage && t2 == Node::numeric_percentage) {
-        return new_Node(Node::boolean, n1.path(), n1.line(), true);
+        return new_Node.boolean(true);
       }
       else if (t1 == Node::numeric_dimension && t2 == Node::numeric_dimension) {
-        string u1(n1.unit().to_string());
-        string u2(n2.unit().to_string());
-        if ((u1 == "ex" && u2 == "ex") ||
-            (u1 == "em" && u2 == "em") ||
-            ((u1 == "in" || u1 == "cm" || u1 == "mm" || u1 == "pt" || u1 == "pc") &&
-             (u2 == "in" || u2 == "cm" || u2 == "mm" || u2 == "pt" || u2 == "pc"))) {
-          return new_Node(Node::boolean, n1.path(), n1.line(), true);
-        }
-        else {
-          return new_Node(Node::boolean, n1.path(), n1.line(), false);
-        }
+        return new_Node.boolean(Unit::comparable(n1.unit_id(), n1.unit(), n2.unit_id(), n2.unit()));
       }
       else if (!n1.is_numeric() && !n2.is_numeric()) {
-        throw_eval_error("arguments to comparable must be numeric", n1.path(), n1.line());
+        throw_eval_error("arguments to comparable must be numeric", n1.file(), n1.offset());
       }
       // default to false if we missed anything
-      return new_Node(Node::boolean, n1.path(), n1.line(), false);
+      return new_Node.boolean(false);
     }
     
     // Boolean Functions ///////////////////////////////////////////////////
     Function_Descriptor not_descriptor =
     { "not", "value", 0 };
-    Node not_impl(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node val(bindings[parameters[0]]);
+    Node not_impl(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node val(args[0]);
       if (val.type() == Node::boolean && val.boolean_value() == false) {
-        return new_Node(Node::boolean, val.path(), val.line(), true);
+        return new_Node.boolean(true);
       }
       else {
-        return new_Node(Node::boolean, val.path(), val.line(), false);
+        return new_Node.boolean(false);
       }
     }
 
     // Misc Functions ///////////////////////////////////////////////////
     Function_Descriptor if_descriptor =
     { "if", "$value", "$string_1", "$string_2", 0 };
-    Node if_impl(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node) {
-      Node val(bindings[parameters[0]]);
-      Node n1(bindings[parameters[1]]);
-      Node n2(bindings[parameters[2]]);
+    Node if_impl(const vector<Token>& parameters, Node args[], Node_Factory& new_Node) {
+      Node val(args[0]);
+      Node n1(args[1]);
+      Node n2(args[2]);
       if (val.type() == Node::boolean && val.boolean_value() == false) {
         return n2;
       }
@@ -8,7 +8,9 @@
 namespace Sass {
   using std::map;
   
-  typedef Node (*Primitive)(const vector<Token>&, map<Token, Node>&, Node_Factory& new_Node);
+  // Primitives get their arguments positionally, in the order of the
+  // parameters in their descriptor; parameters with no argument are null.
+  typedef Node (*Primitive)(const vector<Token>&, Node args[], Node_Factory& new_Node);
   typedef const char* str;
   typedef str Function_Descriptor[];
   
@@ -46,9 +48,19 @@ namespace Sass {
       }
     }
     
-    Node operator()(map<Token, Node>& bindings, Node_Factory& new_Node) const
+    // the position of a keyword argument, or parameters.size() if there's no such parameter
+    size_t parameter(const Token& name) const
     {
-      if (primitive) return primitive(parameters, bindings, new_Node);
+      size_t i = 0;
+      for (size_t S = parameters.size(); i < S; ++i) {
+        if (parameters[i] == name) break;
+      }
+      return i;
+    }
+
+    Node operator()(Node args[], Node_Factory& new_Node) const
+    {
+      if (primitive) return primitive(parameters, args, new_Node);
       else           return Node();
     }
 
@@ -59,98 +71,98 @@ namespace Sass {
     // RGB Functions ///////////////////////////////////////////////////////
 
     extern Function_Descriptor rgb_descriptor;
-    Node rgb(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node rgb(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor rgba_4_descriptor;
-    Node rgba_4(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node rgba_4(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor rgba_2_descriptor;
-    Node rgba_2(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node rgba_2(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor red_descriptor;
-    Node red(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node red(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor green_descriptor;
-    Node green(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node green(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor blue_descriptor;
-    Node blue(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node blue(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor mix_2_descriptor;
-    Node mix_2(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node mix_2(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor mix_3_descriptor;
-    Node mix_3(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node mix_3(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     // HSL Functions ///////////////////////////////////////////////////////
     
     extern Function_Descriptor hsla_descriptor;
-    Node hsla(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node hsla(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor hsl_descriptor;
-    Node hsl(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node hsl(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor invert_descriptor;
-    Node invert(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node invert(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     // Opacity Functions ///////////////////////////////////////////////////
 
     extern Function_Descriptor alpha_descriptor;
     extern Function_Descriptor opacity_descriptor;
-    Node alpha(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node alpha(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor opacify_descriptor;
     extern Function_Descriptor fade_in_descriptor;
-    Node opacify(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node opacify(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor transparentize_descriptor;
     extern Function_Descriptor fade_out_descriptor;
-    Node transparentize(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node transparentize(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     // String Functions ////////////////////////////////////////////////////
 
     extern Function_Descriptor unquote_descriptor;
-    Node unquote(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node unquote(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor quote_descriptor;
-    Node quote(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node quote(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     // Number Functions ////////////////////////////////////////////////////
 
     extern Function_Descriptor percentage_descriptor;
-    Node percentage(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node percentage(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor round_descriptor;
-    Node round(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node round(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor ceil_descriptor;
-    Node ceil(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node ceil(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor floor_descriptor;
-    Node floor(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node floor(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor abs_descriptor;    
-    Node abs(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node abs(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     // List Functions //////////////////////////////////////////////////////
     
     extern Function_Descriptor length_descriptor;
-    Node length(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node length(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor nth_descriptor;
-    Node nth(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node nth(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor join_2_descriptor;    
-    Node join_2(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node join_2(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor join_3_descriptor;    
-    Node join_3(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node join_3(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor append_2_descriptor;
-    Node append_2(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node append_2(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor append_3_descriptor;
-    Node append_3(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node append_3(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor compact_1_descriptor;
     extern Function_Descriptor compact_2_descriptor;
@@ -162,31 +174,31 @@ namespace Sass {
     extern Function_Descriptor compact_8_descriptor;
     extern Function_Descriptor compact_9_descriptor;
     extern Function_Descriptor compact_10_descriptor;
-    Node compact(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node compact(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     // Introspection Functions /////////////////////////////////////////////
     
     extern Function_Descriptor type_of_descriptor;
-    Node type_of(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node type_of(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     extern Function_Descriptor unit_descriptor;
-    Node unit(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node unit(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor unitless_descriptor;    
-    Node unitless(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node unitless(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     extern Function_Descriptor comparable_descriptor;    
-    Node comparable(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node comparable(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
     
     // Boolean Functions ///////////////////////////////////////////////////
     
     extern Function_Descriptor not_descriptor;
-    Node not_impl(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node not_impl(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
     // Misc Functions ///////////////////////////////////////////////////
 
     extern Function_Descriptor if_descriptor;
-    Node if_impl(const vector<Token>& parameters, map<Token, Node>& bindings, Node_Factory& new_Node);
+    Node if_impl(const vector<Token>& parameters, Node args[], Node_Factory& new_Node);
 
 
   }
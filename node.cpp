@@ -1,5 +1,8 @@
 #include <sstream>
 #include <algorithm>
+#include <clocale>
+#include <cctype>
+#include <cstdlib>
 #include "node.hpp"
 #include "error.hpp"
 #include <iostream>
@@ -11,8 +14,43 @@ namespace Sass {
   // Node method implementations
   // ------------------------------------------------------------------------
 
+  __thread size_t Node::nesting     = 0;
+  __thread size_t Node::max_nesting = ~size_t(0);
+
+  Nesting_Guard::Nesting_Guard(const Node& n)
+  {
+    if (Node::nesting >= Node::max_nesting) {
+      stringstream ss;
+      ss << "nested too deeply to write out (more than " << Node::max_nesting << " levels)";
+      throw Error(Error::evaluation, n.file(), n.offset(), ss.str());
+    }
+    ++Node::nesting;
+  }
+
+  static bool is_spliced(Node::Type t)
+  {
+    switch (t)
+    {
+      case Node::expansion:
+      case Node::block:
+      case Node::for_through_directive:
+      case Node::for_to_directive:
+      case Node::each_directive:
+      case Node::while_directive:
+        return true;
+
+      default:
+        return false;
+    }
+  }
+
+  // Splice the statements of nested expansions, blocks and loops into this
+  // node. The result is built in one pass into a fresh list and swapped in,
+  // since erasing and inserting in place is quadratic in the number of
+  // expansions.
   void Node::flatten()
   {
+    Nesting_Guard guard(*this);
     switch (type())
     {
       case block:
@@ -27,32 +65,38 @@ namespace Sass {
       default:
         return;
     }
-    // size can change during flattening, so we need to call size() on each pass
-    for (size_t i = 0; i < size(); ++i) {
-      switch (at(i).type())
-      {
-        case expansion:
-        case block:
-        case for_through_directive:
-        case for_to_directive:
-        case each_directive:
-        case while_directive: {
-          Node expn(at(i));
-          if (expn.has_expansions()) expn.flatten();
-          ip_->has_statements |= expn.has_statements();
-          ip_->has_blocks     |= expn.has_blocks();
-          ip_->has_expansions |= expn.has_expansions();
-          // TO DO: make this more efficient -- replace with a dummy node instead of erasing
-          ip_->children.erase(begin() + i);
-          insert(begin() + i, expn.begin(), expn.end());
-          // skip over what we just spliced in
-          i += expn.size() - 1;
-        } break;
+    Node* p = begin();
+    Node* last = end();
+    while (p != last && !is_spliced(p->type())) ++p;
+    if (p == last) return;
 
-        default: {
-        } break;
+    Node_List flat;
+    flat.reserve(size());
+    flat.insert(flat.end(), begin(), p);
+    for (; p != last; ++p) {
+      if (!is_spliced(p->type())) {
+        flat.push_back(*p);
+        continue;
       }
+      Node expn(*p);
+      if (expn.has_expansions()) expn.flatten();
+      ip_->flag(Node_Impl::has_statements_flag) |= expn.has_statements();
+      ip_->flag(Node_Impl::has_blocks_flag)     |= expn.has_blocks();
+      ip_->flag(Node_Impl::has_expansions_flag) |= expn.has_expansions();
+      flat.insert(flat.end(), expn.begin(), expn.end());
     }
+    ip_->children.swap(flat);
+  }
+
+  // Mark a subtree as shared between expansions. Eval never modifies a shared
+  // node in place, so mixin and function bodies can be reused without being
+  // cloned first. Children of a shared node are always shared, so there's no
+  // need to descend into a subtree that's already frozen.
+  void Node::freeze()
+  {
+    if (is_shared()) return;
+    ip_->set(Node_Impl::is_shared_flag);
+    for (size_t i = 0, S = size(); i < S; ++i) at(i).freeze();
   }
 
   string Node::unquote() const
@@ -110,8 +154,8 @@ namespace Sass {
       } break;
       
       case numeric_dimension: {
-        if (unit() == rhs.unit()) {
-          return numeric_value() == rhs.numeric_value();
+        if (Unit::comparable(unit_id(), unit(), rhs.unit_id(), rhs.unit())) {
+          return numeric_value() == Unit::convert(rhs.numeric_value(), rhs.unit_id(), unit_id());
         }
         else {
           return false;
@@ -145,11 +189,11 @@ namespace Sass {
 
     // comparing numbers with units
     else if (lhs_type == numeric_dimension && rhs_type == numeric_dimension) {
-      if (unit() == rhs.unit()) {
-        return numeric_value() < rhs.numeric_value();
+      if (Unit::comparable(unit_id(), unit(), rhs.unit_id(), rhs.unit())) {
+        return numeric_value() < Unit::convert(rhs.numeric_value(), rhs.unit_id(), unit_id());
       }
       else {
-        throw Error(Error::evaluation, path(), line(), "incompatible units");
+        throw Error(Error::evaluation, file(), offset(), "incompatible units");
       }
     }
 
@@ -196,7 +240,7 @@ namespace Sass {
 
     // catch-all
     else {
-      throw Error(Error::evaluation, path(), line(), "incomparable types");
+      throw Error(Error::evaluation, file(), offset(), "incomparable types");
     }
   }
   
@@ -289,6 +333,42 @@ namespace Sass {
     }
   }
   
+  // Up to 19 digits fit in an integer, and as long as that's exactly
+  // representable, one division by an exact power of ten gives the correctly
+  // rounded result. Anything longer is left to strtod, with the decimal point
+  // spelled the way the current locale expects.
+  double Token::to_number() const
+  {
+    static const double powers_of_ten[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+      1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19
+    };
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) negative = (*p++ == '-');
+    unsigned long long mantissa = 0;
+    size_t digits = 0;
+    size_t scale = 0;
+    bool point = false;
+    for (; p < end; ++p) {
+      if (*p >= '0' && *p <= '9') {
+        if (digits < 19) mantissa = mantissa * 10 + (*p - '0');
+        ++digits;
+        if (point) ++scale;
+      }
+      else if (*p == '.' && !point) point = true;
+      else break;
+    }
+    if (digits <= 19 && mantissa <= (1ULL << 53)) {
+      double value = static_cast<double>(mantissa) / powers_of_ten[scale];
+      return negative ? -value : value;
+    }
+    string text(begin, p);
+    size_t dot = text.find('.');
+    if (dot != string::npos) text.replace(dot, 1, localeconv()->decimal_point);
+    return std::strtod(text.c_str(), 0);
+  }
+
   bool Token::operator<(const Token& rhs) const
   {
     const char* first1 = begin;
@@ -319,6 +399,75 @@ namespace Sass {
   }
 
 
+  // ------------------------------------------------------------------------
+  // Unit method implementations
+  // ------------------------------------------------------------------------
+
+  struct Unit_Entry {
+    const char* name;
+    size_t      length;
+    Unit::Group group;
+    double      factor;
+  };
+
+  // id 0 is every unit that isn't listed; units are case-insensitive, as
+  // in CSS, and spelled here the way CSS usually writes them
+  static const Unit_Entry unit_table[] = {
+    { "",     0, Unit::none,       1                    },
+    { "px",   2, Unit::length,     1                    },
+    { "in",   2, Unit::length,     96                   },
+    { "cm",   2, Unit::length,     96 / 2.54            },
+    { "mm",   2, Unit::length,     96 / 25.4            },
+    { "Q",    1, Unit::length,     96 / 101.6           },
+    { "pt",   2, Unit::length,     96.0 / 72            },
+    { "pc",   2, Unit::length,     16                   },
+    { "deg",  3, Unit::angle,      1                    },
+    { "grad", 4, Unit::angle,      0.9                  },
+    { "rad",  3, Unit::angle,      57.295779513082323   },
+    { "turn", 4, Unit::angle,      360                  },
+    { "s",    1, Unit::time,       1                    },
+    { "ms",   2, Unit::time,       0.001                },
+    { "Hz",   2, Unit::frequency,  1                    },
+    { "kHz",  3, Unit::frequency,  1000                 },
+    { "dppx", 4, Unit::resolution, 1                    },
+    { "dpi",  3, Unit::resolution, 1 / 96.0             },
+    { "dpcm", 4, Unit::resolution, 2.54 / 96            }
+  };
+  static const size_t unit_count = sizeof(unit_table) / sizeof(unit_table[0]);
+
+  unsigned int Unit::id(const Token& name)
+  {
+    size_t len = name.length();
+    for (unsigned int i = 1; i < unit_count; ++i) {
+      if (unit_table[i].length != len) continue;
+      size_t j = 0;
+      while (j < len && std::tolower(unit_table[i].name[j]) == std::tolower(static_cast<unsigned char>(name.begin[j]))) ++j;
+      if (j == len) return i;
+    }
+    return 0;
+  }
+
+  Unit::Group Unit::group(unsigned int id)
+  { return unit_table[id].group; }
+
+  double Unit::factor(unsigned int id)
+  { return unit_table[id].factor; }
+
+  bool Unit::comparable(unsigned int id1, const Token& u1, unsigned int id2, const Token& u2)
+  {
+    if (id1 || id2) return unit_table[id1].group == unit_table[id2].group && unit_table[id1].group != none;
+    return u1 == u2;
+  }
+
+  // Multiplying before dividing keeps conversions that should come out
+  // exact (96px to 1in, say) exact.
+  double Unit::convert(double v, unsigned int from, unsigned int to)
+  {
+    if (from == to) return v;
+    return v * unit_table[from].factor / unit_table[to].factor;
+  }
+
+
   // ------------------------------------------------------------------------
   // Node_Impl method implementations
   // ------------------------------------------------------------------------
@@ -332,6 +481,11 @@ namespace Sass {
         return value.numeric;
       case Node::numeric_dimension:
         return value.dimension.numeric;
+      case Node::textual_number:
+      case Node::textual_percentage:
+      case Node::textual_dimension:
+      case Node::textual_hex:
+        return value.literal.numeric;
       default:
         break;
         // throw an exception?
@@ -4,6 +4,9 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <new>
+#include <algorithm>
+#include <stdexcept>
 
 namespace Sass {
   using namespace std;
@@ -46,6 +49,9 @@ namespace Sass {
 
     string unquote() const;
     void   unquote_to_stream(std::stringstream& buf) const;
+    // the value of the number the token starts with, read the same way
+    // whatever the locale
+    double to_number() const;
     
     operator bool()
     { return begin && end && begin >= end; }
@@ -58,8 +64,65 @@ namespace Sass {
     double numeric;
     Token unit;
   };
-  
+
+  // Textual numbers, percentages, dimensions and hex colors keep the text
+  // they were written as (that's what gets emitted if they're never
+  // evaluated) next to the value the parser read from it. Hex colors pack
+  // their channels into one number, as 0xRRGGBB.
+  struct Literal {
+    Token  token;
+    double numeric;
+  };
+
+  // Units that convert into one another (absolute lengths, angles, times,
+  // frequencies and resolutions) are looked up once, when a dimension is
+  // made, and kept as a small id into a fixed table. Every other unit has id
+  // 0 and is only ever comparable with itself, by name.
+  struct Unit {
+    enum Group { none, length, angle, time, frequency, resolution };
+
+    static unsigned int id(const Token& name);
+    static Group group(unsigned int id);
+    // how many of the group's base unit (px, deg, s, Hz, dppx) one of these is
+    static double factor(unsigned int id);
+
+    static bool comparable(unsigned int id1, const Token& u1, unsigned int id2, const Token& u2);
+    // only meaningful for comparable units
+    static double convert(double v, unsigned int from, unsigned int to);
+  };
+
   struct Node_Impl;
+  struct Function;
+
+  // A reference to one bit of a Node_Impl's packed flags, so that accessors
+  // like should_eval() can still be assigned through.
+  class Flag_Ref {
+    unsigned short& bits_;
+    unsigned short  mask_;
+  public:
+    Flag_Ref(unsigned short& bits, unsigned short mask)
+    : bits_(bits), mask_(mask)
+    { }
+
+    operator bool() const
+    { return bits_ & mask_; }
+
+    Flag_Ref& operator=(bool b)
+    {
+      if (b) bits_ |= mask_;
+      else   bits_ &= ~mask_;
+      return *this;
+    }
+
+    Flag_Ref& operator=(const Flag_Ref& f)
+    { return *this = bool(f); }
+
+    Flag_Ref& operator|=(bool b)
+    {
+      if (b) bits_ |= mask_;
+      return *this;
+    }
+  };
 
   class Node {
   private:
@@ -181,15 +244,20 @@ namespace Sass {
     bool has_expansions() const;
     bool has_backref() const;
     bool from_variable() const;
-    bool& should_eval() const;
-    bool& is_unquoted() const;
-    bool& is_quoted() const;
+    Flag_Ref should_eval() const;
+    Flag_Ref is_unquoted() const;
+    Flag_Ref is_quoted() const;
     bool is_numeric() const;
     bool is_guarded() const;
-    bool& has_been_extended() const;
-
-    string& path() const;
-    size_t line() const;
+    Flag_Ref has_been_extended() const;
+    bool is_shared() const;
+
+    size_t file() const;
+    size_t offset() const;
+    unsigned int& symbol() const;
+    const Function*& callee() const;
+    size_t slot() const;
+    void   set_slot(size_t s);
     size_t size() const;
     bool empty() const;
 
@@ -202,21 +270,21 @@ namespace Sass {
     Node& operator<<(Node n);
     Node& operator+=(Node n);
 
-    vector<Node>::iterator begin() const;
-    vector<Node>::iterator end() const;
-    void insert(vector<Node>::iterator position,
-                vector<Node>::iterator first,
-                vector<Node>::iterator last);
+    Node* begin() const;
+    Node* end() const;
+    void insert(Node* position, Node* first, Node* last);
 
     bool   boolean_value() const;
     double numeric_value() const;
     Token  token() const;
     Token  unit() const;
+    unsigned int unit_id() const;
 
     bool is_null_ptr() const { return !ip_; }
     bool is(Node n) const { return ip_ == n.ip_; }
 
     void flatten();
+    void freeze();
 
     string unquote() const;
     
@@ -233,52 +301,205 @@ namespace Sass {
     void echo(stringstream& buf, size_t depth = 0);
     void emit_expanded_css(stringstream& buf, const string& prefix);
 
+    // Flattening and emitting recurse over the tree, and values built up in
+    // loops can be nested arbitrarily deep, so those walks fail once
+    // max_nesting of them are in progress rather than overflow the stack.
+    // Both are per thread; Context sets max_nesting to its max_depth.
+    static __thread size_t nesting;
+    static __thread size_t max_nesting;
+  };
+
+  struct Nesting_Guard {
+    Nesting_Guard(const Node& n);
+    ~Nesting_Guard() { --Node::nesting; }
   };
   
+  // Children are kept inline when there are only a few of them, which covers
+  // most nodes (numbers, colors, rules, binary operations); longer lists
+  // spill over into a heap block. Nodes are plain handles, so elements are
+  // moved around with memcpy/memmove.
+  class Node_List {
+    enum { inline_capacity = 4 };
+    union {
+      Node* heap;
+      char  local[inline_capacity * sizeof(Node)];
+      void* align;
+    } store_;
+    unsigned int size_;
+    unsigned int capacity_;
+
+    bool on_heap() const
+    { return capacity_ > inline_capacity; }
+
+    void grow(size_t needed)
+    {
+      size_t cap = capacity_ * 2;
+      if (cap < needed) cap = needed;
+      Node* fresh = static_cast<Node*>(::operator new(cap * sizeof(Node)));
+      std::memcpy(static_cast<void*>(fresh), begin(), size_ * sizeof(Node));
+      if (on_heap()) ::operator delete(store_.heap);
+      store_.heap = fresh;
+      capacity_ = cap;
+    }
+
+    void assign(const Node_List& other)
+    {
+      size_ = 0;
+      reserve(other.size_);
+      std::memcpy(static_cast<void*>(begin()), other.begin(), other.size_ * sizeof(Node));
+      size_ = other.size_;
+    }
+
+  public:
+    Node_List() : size_(0), capacity_(inline_capacity)
+    { }
+
+    Node_List(const Node_List& other) : size_(0), capacity_(inline_capacity)
+    { assign(other); }
+
+    Node_List& operator=(const Node_List& other)
+    {
+      if (this != &other) assign(other);
+      return *this;
+    }
+
+    ~Node_List()
+    { if (on_heap()) ::operator delete(store_.heap); }
+
+    Node* begin() const
+    { return on_heap() ? store_.heap : reinterpret_cast<Node*>(const_cast<char*>(store_.local)); }
+
+    Node* end() const
+    { return begin() + size_; }
+
+    size_t size() const
+    { return size_; }
+
+    bool empty() const
+    { return !size_; }
+
+    Node& operator[](size_t i) const
+    { return begin()[i]; }
+
+    Node& at(size_t i) const
+    {
+      if (i >= size_) throw std::out_of_range("Node_List::at");
+      return begin()[i];
+    }
+
+    Node& back() const
+    { return begin()[size_ - 1]; }
+
+    void reserve(size_t n)
+    { if (n > capacity_) grow(n); }
+
+    void push_back(const Node& n)
+    {
+      if (size_ == capacity_) {
+        Node copy(n); // n might live in this list
+        grow(size_ + 1);
+        new (end()) Node(copy);
+      }
+      else new (end()) Node(n);
+      ++size_;
+    }
+
+    void pop_back()
+    { --size_; }
+
+    void insert(Node* position, const Node* first, const Node* last)
+    {
+      size_t offset = position - begin();
+      size_t count  = last - first;
+      if (!count) return;
+      if (size_ + count > capacity_) {
+        // the source range must come from another list
+        grow(size_ + count);
+      }
+      Node* pos = begin() + offset;
+      std::memmove(static_cast<void*>(pos + count), pos, (size_ - offset) * sizeof(Node));
+      std::memcpy(static_cast<void*>(pos), first, count * sizeof(Node));
+      size_ += count;
+    }
+
+    void insert(Node* position, const Node& n)
+    {
+      Node copy(n);
+      insert(position, &copy, &copy + 1);
+    }
+
+    void erase(Node* position)
+    {
+      std::memmove(static_cast<void*>(position), position + 1, (end() - position - 1) * sizeof(Node));
+      --size_;
+    }
+
+    void swap(Node_List& other)
+    {
+      std::swap(store_, other.store_);
+      std::swap(size_, other.size_);
+      std::swap(capacity_, other.capacity_);
+    }
+  };
+
   struct Node_Impl {
     union value_t {
       bool         boolean;
       double       numeric;
       Token        token;
       Dimension    dimension;
+      Literal      literal;
+      const Function* callee; // for function calls; see eval
     } value;
 
-    // TO DO: look into using a custom allocator in the Node_Factory class
-    vector<Node> children; // Can't be in the union because it has non-trivial constructors!
-
-    string path;
-    size_t line;
-
-    Node::Type type;
-
-    bool has_children;
-    bool has_statements;
-    bool has_blocks;
-    bool has_expansions;
-    bool has_backref;
-    bool from_variable;
-    bool should_eval;
-    bool is_unquoted;
-    bool is_quoted;
-    bool has_been_extended;
+    Node_List children;
+
+    unsigned int offset; // into the text of file; see Context::line_of
+    unsigned int symbol; // interned name of variables, mixins and functions;
+                         // the Unit id of numeric dimensions
+    // Names get the index of their slot in the frames of the scope they're
+    // evaluated in; blocks, mixins, functions and loops get the id of the
+    // scope they open. Filled in by resolve (see eval_apply.cpp).
+    unsigned int slot : 24;
+    Node::Type type : 8;
+    unsigned short file;
+
+    enum {
+      has_children_flag      = 1 << 0,
+      has_statements_flag    = 1 << 1,
+      has_blocks_flag        = 1 << 2,
+      has_expansions_flag    = 1 << 3,
+      has_backref_flag       = 1 << 4,
+      from_variable_flag     = 1 << 5,
+      should_eval_flag       = 1 << 6,
+      is_unquoted_flag       = 1 << 7, // for strings
+      is_quoted_flag         = 1 << 8, // for identifiers -- yeah, it's hacky for now
+      has_been_extended_flag = 1 << 9,
+      is_shared_flag         = 1 << 10, // part of a mixin/function/loop body; see Node::freeze
+      marked_flag            = 1 << 11  // reachable; only set during Node_Factory::collect
+    };
+    enum { no_slot = (1 << 24) - 1 };
+    unsigned short flags;
 
     Node_Impl()
     : /* value(value_t()),
-      children(vector<Node>()),
-      path(string()),
-      line(0),
-      type(Node::none), */
-      has_children(false),
-      has_statements(false),
-      has_blocks(false),
-      has_expansions(false),
-      has_backref(false),
-      from_variable(false),
-      should_eval(false),
-      is_unquoted(false), // for strings
-      is_quoted(false),  // for identifiers -- yeah, it's hacky for now
-      has_been_extended(false)
+      children(Node_List()),
+      offset(0), */
+      symbol(0),
+      slot(no_slot),
+      /* type(Node::none),
+      file(0), */
+      flags(0)
     { }
+
+    bool has(unsigned short f) const
+    { return flags & f; }
+
+    void set(unsigned short f)
+    { flags |= f; }
+
+    Flag_Ref flag(unsigned short f)
+    { return Flag_Ref(flags, f); }
     
     bool is_numeric()
     { return type >= Node::number && type <= Node::numeric_dimension; }
@@ -298,7 +519,7 @@ namespace Sass {
     void push_back(const Node& n)
     {
       children.push_back(n);
-      has_children = true;
+      set(has_children_flag);
       switch (n.type())
       {
         case Node::comment:
@@ -308,12 +529,12 @@ namespace Sass {
         case Node::warning:
         case Node::block_directive:
         case Node::blockless_directive: {
-          has_statements = true;
+          set(has_statements_flag);
         } break;
 
         case Node::media_query:
         case Node::ruleset: {
-          has_blocks = true;
+          set(has_blocks_flag);
         } break;
 
         case Node::block:
@@ -323,44 +544,44 @@ namespace Sass {
         case Node::each_directive:
         case Node::while_directive:
         case Node::expansion: {
-          has_expansions = true;
+          set(has_expansions_flag);
         } break;
 
         case Node::backref: {
-          has_backref = true;
+          set(has_backref_flag);
         } break;
 
         default: break;
       }
-      if (n.has_backref()) has_backref = true;
+      if (n.has_backref()) set(has_backref_flag);
     }
 
     void push_front(const Node& n)
     {
       children.insert(children.begin(), n);
-      has_children = true;
+      set(has_children_flag);
       switch (n.type())
       {
         case Node::comment:
         case Node::css_import:
         case Node::rule:
-        case Node::propset:   has_statements = true; break;
+        case Node::propset:   set(has_statements_flag); break;
 
         case Node::media_query:
-        case Node::ruleset:   has_blocks     = true; break;
+        case Node::ruleset:   set(has_blocks_flag);     break;
 
         case Node::if_directive:
         case Node::for_through_directive:
         case Node::for_to_directive:
         case Node::each_directive:
         case Node::while_directive:
-        case Node::expansion: has_expansions = true; break;
+        case Node::expansion: set(has_expansions_flag); break;
 
-        case Node::backref:   has_backref    = true; break;
+        case Node::backref:   set(has_backref_flag);    break;
 
-        default:                                     break;
+        default:                                        break;
       }
-      if (n.has_backref()) has_backref = true;
+      if (n.has_backref()) set(has_backref_flag);
     }
 
     void pop_back()
@@ -384,21 +605,26 @@ namespace Sass {
   
   inline Node::Type Node::type() const    { return ip_->type; }
   
-  inline bool Node::has_children() const   { return ip_->has_children; }
-  inline bool Node::has_statements() const { return ip_->has_statements; }
-  inline bool Node::has_blocks() const     { return ip_->has_blocks; }
-  inline bool Node::has_expansions() const { return ip_->has_expansions; }
-  inline bool Node::has_backref() const    { return ip_->has_backref; }
-  inline bool Node::from_variable() const  { return ip_->from_variable; }
-  inline bool& Node::should_eval() const   { return ip_->should_eval; }
-  inline bool& Node::is_unquoted() const   { return ip_->is_unquoted; }
-  inline bool& Node::is_quoted() const     { return ip_->is_quoted; }
-  inline bool Node::is_numeric() const     { return ip_->is_numeric(); }
-  inline bool Node::is_guarded() const     { return (type() == assignment) && (size() == 3); }
-  inline bool& Node::has_been_extended() const { return ip_->has_been_extended; }
+  inline bool Node::has_children() const       { return ip_->has(Node_Impl::has_children_flag); }
+  inline bool Node::has_statements() const     { return ip_->has(Node_Impl::has_statements_flag); }
+  inline bool Node::has_blocks() const         { return ip_->has(Node_Impl::has_blocks_flag); }
+  inline bool Node::has_expansions() const     { return ip_->has(Node_Impl::has_expansions_flag); }
+  inline bool Node::has_backref() const        { return ip_->has(Node_Impl::has_backref_flag); }
+  inline bool Node::from_variable() const      { return ip_->has(Node_Impl::from_variable_flag); }
+  inline Flag_Ref Node::should_eval() const    { return ip_->flag(Node_Impl::should_eval_flag); }
+  inline Flag_Ref Node::is_unquoted() const    { return ip_->flag(Node_Impl::is_unquoted_flag); }
+  inline Flag_Ref Node::is_quoted() const      { return ip_->flag(Node_Impl::is_quoted_flag); }
+  inline bool Node::is_numeric() const         { return ip_->is_numeric(); }
+  inline bool Node::is_guarded() const         { return (type() == assignment) && (size() == 3); }
+  inline Flag_Ref Node::has_been_extended() const { return ip_->flag(Node_Impl::has_been_extended_flag); }
+  inline bool Node::is_shared() const          { return ip_->has(Node_Impl::is_shared_flag); }
   
-  inline string& Node::path() const  { return ip_->path; }
-  inline size_t  Node::line() const  { return ip_->line; }
+  inline size_t  Node::file() const  { return ip_->file; }
+  inline size_t  Node::offset() const { return ip_->offset; }
+  inline unsigned int& Node::symbol() const { return ip_->symbol; }
+  inline const Function*& Node::callee() const { return ip_->value.callee; }
+  inline size_t  Node::slot() const  { return ip_->slot; }
+  inline void    Node::set_slot(size_t s) { ip_->slot = s; }
   inline size_t  Node::size() const  { return ip_->size(); }
   inline bool    Node::empty() const { return ip_->empty(); }
   
@@ -423,18 +649,17 @@ namespace Sass {
     return *this;
   }
 
-  inline vector<Node>::iterator Node::begin() const
+  inline Node* Node::begin() const
   { return ip_->children.begin(); }
-  inline vector<Node>::iterator Node::end() const
+  inline Node* Node::end() const
   { return ip_->children.end(); }
-  inline void Node::insert(vector<Node>::iterator position,
-                           vector<Node>::iterator first,
-                           vector<Node>::iterator last)
+  inline void Node::insert(Node* position, Node* first, Node* last)
   { ip_->children.insert(position, first, last); }
 
   inline bool   Node::boolean_value() const { return ip_->boolean_value(); }
   inline double Node::numeric_value() const { return ip_->numeric_value(); }
   inline Token  Node::token() const         { return ip_->value.token; }
   inline Token  Node::unit() const          { return ip_->unit(); }
+  inline unsigned int Node::unit_id() const { return ip_->symbol; }
 
 }
@@ -17,6 +17,7 @@ namespace Sass {
 
   string Node::to_string(Type inside_of) const
   {
+    Nesting_Guard guard(*this);
     switch (type())
     {
       case selector_group:
@@ -346,17 +347,7 @@ namespace Sass {
       } break;
 
       case warning: {
-        string prefix("WARNING: ");
-        string indent("         ");
-        Node contents(at(0));
-        string result(contents.to_string());
-        if (contents.type() == string_constant || contents.type() == string_schema) {
-          result = result.substr(1, result.size()-2); // unquote if it's a single string
-        }
-        // These cerrs aren't log lines! They're supposed to be here!
-        cerr << prefix << result << endl;
-        cerr << indent << "on line " << at(0).line() << " of " << at(0).path();
-        cerr << endl << endl;
+        // warnings are reported to cerr as they're evaluated
         return "";
       } break;
       
@@ -370,6 +361,7 @@ namespace Sass {
 
   void Node::emit_nested_css(stringstream& buf, size_t depth, bool at_toplevel, bool in_media_query)
   {
+    Nesting_Guard guard(*this);
     switch (type())
     {
       case root: {
@@ -499,6 +491,7 @@ namespace Sass {
   
   void Node::emit_propset(stringstream& buf, size_t depth, const string& prefix)
   {
+    Nesting_Guard guard(*this);
     string new_prefix(prefix);
     // bool has_prefix = false;
     if (new_prefix.empty()) {
@@ -1,24 +1,55 @@
+#include <new>
 #include "node_factory.hpp"
 
 namespace Sass {
+
+  Node_Factory::Node_Factory()
+  : chunks_(vector<Node_Impl*>()), chunk_used_(chunk_size),
+    free_slots_(vector<Node_Impl*>()), scope_log_(vector<Node_Impl*>()),
+    scope_depth_(0), next_collection_(0),
+    true_(Node()), false_(Node()), nil_(Node()),
+    small_numbers_(vector<Node>(small_number_limit))
+  { }
+
+  // Bump-allocate raw storage for one Node_Impl, starting a new chunk when
+  // the current one is full, unless there's a reclaimed slot to reuse. The
+  // caller is responsible for constructing it.
+  Node_Impl* Node_Factory::next_slot()
+  {
+    Node_Impl* slot;
+    if (!free_slots_.empty()) {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+    }
+    else {
+      if (chunk_used_ == chunk_size) {
+        void* chunk = ::operator new(chunk_size * sizeof(Node_Impl));
+        chunks_.push_back(static_cast<Node_Impl*>(chunk));
+        chunk_used_ = 0;
+      }
+      slot = chunks_.back() + chunk_used_++;
+    }
+    if (scope_depth_) scope_log_.push_back(slot);
+    return slot;
+  }
   
-  Node_Impl* Node_Factory::alloc_Node_Impl(Node::Type type, string path, size_t line)
+  Node_Impl* Node_Factory::alloc_Node_Impl(Node::Type type, size_t file, size_t offset)
   {
-    Node_Impl* ip = new Node_Impl();
+    Node_Impl* ip = new (next_slot()) Node_Impl();
     ip->type = type;
-    if (type == Node::backref) ip->has_backref = true;
-    ip->path = path;
-    ip->line = line;
-    pool_.push_back(ip);
+    if (type == Node::backref) ip->set(Node_Impl::has_backref_flag);
+    if (type == Node::function_call) ip->value.callee = 0;
+    ip->file = file;
+    ip->offset = offset;
     return ip;
   }
 
   // returns a deep-copy of its argument
   Node_Impl* Node_Factory::alloc_Node_Impl(Node_Impl* ip)
   {
-    Node_Impl* ip_cpy = new Node_Impl(*ip);
-    pool_.push_back(ip_cpy);
-    if (ip_cpy->has_children) {
+    Node_Impl* ip_cpy = new (next_slot()) Node_Impl(*ip);
+    ip_cpy->flags &= ~Node_Impl::is_shared_flag;
+    if (ip_cpy->has(Node_Impl::has_children_flag)) {
       for (size_t i = 0, S = ip_cpy->size(); i < S; ++i) {
         Node n(ip_cpy->at(i));
         ip_cpy->at(i) = (*this)(n);
@@ -34,18 +65,25 @@ namespace Sass {
     return Node(ip_cpy);
   }
 
+  Node Node_Factory::shallow_copy(const Node& n1)
+  {
+    Node_Impl* ip_cpy = new (next_slot()) Node_Impl(*n1.ip_);
+    ip_cpy->flags &= ~Node_Impl::is_shared_flag;
+    return Node(ip_cpy);
+  }
+
   // for making leaf nodes out of terminals/tokens
-  Node Node_Factory::operator()(Node::Type type, string path, size_t line, Token t)
+  Node Node_Factory::operator()(Node::Type type, size_t file, size_t offset, Token t)
   {
-    Node_Impl* ip = alloc_Node_Impl(type, path, line);
+    Node_Impl* ip = alloc_Node_Impl(type, file, offset);
     ip->value.token = t;
     return Node(ip);
   }
 
   // for making boolean values or interior nodes that have children
-  Node Node_Factory::operator()(Node::Type type, string path, size_t line, size_t size)
+  Node Node_Factory::operator()(Node::Type type, size_t file, size_t offset, size_t size)
   {
-    Node_Impl* ip = alloc_Node_Impl(type, path, line);
+    Node_Impl* ip = alloc_Node_Impl(type, file, offset);
 
     if (type == Node::boolean) ip->value.boolean = size;
     else                       ip->children.reserve(size);
@@ -54,34 +92,153 @@ namespace Sass {
   }
 
   // for making nodes representing numbers
-  Node Node_Factory::operator()(string path, size_t line, double v, Node::Type type)
+  Node Node_Factory::operator()(size_t file, size_t offset, double v, Node::Type type)
   {
-    Node_Impl* ip = alloc_Node_Impl(type, path, line);
+    Node_Impl* ip = alloc_Node_Impl(type, file, offset);
     ip->value.numeric = v;
     return Node(ip);
   }
 
+  // for making literals, which keep their text along with its value
+  Node Node_Factory::operator()(Node::Type type, size_t file, size_t offset, Token t, double v)
+  {
+    Node_Impl* ip = alloc_Node_Impl(type, file, offset);
+    ip->value.literal.token = t;
+    ip->value.literal.numeric = v;
+    return Node(ip);
+  }
+
   // for making nodes representing numeric dimensions (e.g. 5px, 3em)
-  Node Node_Factory::operator()(string path, size_t line, double v, const Token& t)
+  Node Node_Factory::operator()(size_t file, size_t offset, double v, const Token& t)
   {
-    Node_Impl* ip = alloc_Node_Impl(Node::numeric_dimension, path, line);
+    Node_Impl* ip = alloc_Node_Impl(Node::numeric_dimension, file, offset);
     ip->value.dimension.numeric = v;
     ip->value.dimension.unit = t;
+    ip->symbol = Unit::id(t);
     return Node(ip);
   }
   
   // for making nodes representing rgba color quads
-  Node Node_Factory::operator()(string path, size_t line, double r, double g, double b, double a)
+  Node Node_Factory::operator()(size_t file, size_t offset, double r, double g, double b, double a)
   {
-    Node color((*this)(Node::numeric_color, path, line, 4));
-    color << (*this)(path, line, r)
-          << (*this)(path, line, g)
-          << (*this)(path, line, b)
-          << (*this)(path, line, a);
+    Node color((*this)(Node::numeric_color, file, offset, 4));
+    color << (*this)(file, offset, r)
+          << (*this)(file, offset, g)
+          << (*this)(file, offset, b)
+          << (*this)(file, offset, a);
     return color;
   }
 
+  Node Node_Factory::canonical(Node& slot, Node n)
+  {
+    n.freeze();
+    slot = n;
+    return n;
+  }
+
+  Node Node_Factory::boolean(bool b)
+  {
+    Node& slot = b ? true_ : false_;
+    return slot.is_null_ptr() ? canonical(slot, (*this)(Node::boolean, 0, 0, b)) : slot;
+  }
+
+  Node Node_Factory::nil()
+  { return nil_.is_null_ptr() ? canonical(nil_, (*this)(Node::nil, 0, 0, 0)) : nil_; }
+
+  Node Node_Factory::number(size_t file, size_t offset, double v)
+  {
+    if (!(v >= 0 && v < small_number_limit) || v != static_cast<size_t>(v)) return (*this)(file, offset, v);
+    Node& slot = small_numbers_[static_cast<size_t>(v)];
+    return slot.is_null_ptr() ? canonical(slot, (*this)(0, 0, v)) : slot;
+  }
+
+  size_t Node_Factory::open_scope()
+  {
+    ++scope_depth_;
+    next_collection_ = 0;
+    return scope_log_.size();
+  }
+
+  // Nodes that survive an inner scope become candidates for the enclosing
+  // one; once the outermost scope is closed they're permanent.
+  void Node_Factory::close_scope()
+  {
+    --scope_depth_;
+    if (!scope_depth_) scope_log_.clear();
+  }
+
+  // Collecting means walking everything reachable from the roots, so wait
+  // until the scope has allocated a fair amount since the last collection
+  // (at least as much as survived it).
+  bool Node_Factory::should_collect(size_t scope) const
+  {
+    return scope_log_.size() - scope >= collect_threshold &&
+           scope_log_.size() >= next_collection_;
+  }
+
+  void Node_Factory::collect(size_t scope, const vector<Node>& roots)
+  {
+    // mark
+    vector<Node_Impl*> marked;
+    vector<Node_Impl*> pending;
+    for (size_t i = 0, S = roots.size(); i < S; ++i) {
+      if (!roots[i].is_null_ptr()) pending.push_back(roots[i].ip_);
+    }
+    while (!pending.empty()) {
+      Node_Impl* ip = pending.back();
+      pending.pop_back();
+      // Shared nodes are never modified, and bodies are only ever frozen
+      // outside of any scope, so nothing underneath them can be a candidate.
+      if (ip->has(Node_Impl::marked_flag | Node_Impl::is_shared_flag)) continue;
+      ip->set(Node_Impl::marked_flag);
+      marked.push_back(ip);
+      for (Node* child = ip->children.begin(), *E = ip->children.end(); child != E; ++child) {
+        pending.push_back(child->ip_);
+      }
+    }
+    // sweep this scope's part of the log, keeping the survivors in it
+    size_t kept = scope;
+    for (size_t i = scope, S = scope_log_.size(); i < S; ++i) {
+      Node_Impl* ip = scope_log_[i];
+      if (ip->has(Node_Impl::marked_flag | Node_Impl::is_shared_flag)) {
+        scope_log_[kept++] = ip;
+      }
+      else {
+        // leave a blank Node_Impl behind so that free() can still destroy it
+        ip->~Node_Impl();
+        new (ip) Node_Impl();
+        free_slots_.push_back(ip);
+      }
+    }
+    scope_log_.resize(kept);
+    for (size_t i = 0, S = marked.size(); i < S; ++i) {
+      marked[i]->flags &= ~Node_Impl::marked_flag;
+    }
+    next_collection_ = kept + (kept - scope);
+  }
+
+  size_t Node_Factory::size() const
+  {
+    size_t used = chunks_.empty() ? 0 : (chunks_.size() - 1) * chunk_size + chunk_used_;
+    return used - free_slots_.size();
+  }
+
+  // Node_Impls whose children spilled onto the heap own that block, so they have to
+  // be destroyed individually, but their storage goes back a chunk at a time.
   void Node_Factory::free()
-  { for (size_t i = 0, S = pool_.size(); i < S; ++i) delete pool_[i]; }
+  {
+    for (size_t i = 0, S = chunks_.size(); i < S; ++i) {
+      size_t used = (i == S - 1) ? chunk_used_ : chunk_size;
+      for (size_t j = 0; j < used; ++j) chunks_[i][j].~Node_Impl();
+      ::operator delete(chunks_[i]);
+    }
+    chunks_.clear();
+    chunk_used_ = chunk_size;
+    free_slots_.clear();
+    scope_log_.clear();
+    scope_depth_ = 0;
+    true_ = false_ = nil_ = Node();
+    small_numbers_.assign(small_number_limit, Node());
+  }
 
 }
\ No newline at end of file
@@ -9,29 +9,68 @@ namespace Sass {
 
   struct Token;
   struct Node_Impl;
-  
+
   class Node_Factory {
-    vector<Node_Impl*> pool_;
-    Node_Impl* alloc_Node_Impl(Node::Type type, string file, size_t line);
+    // Node_Impls are carved out of fixed-size chunks instead of being
+    // allocated one at a time; free() releases the chunks in bulk.
+    static const size_t chunk_size = 1024;
+    vector<Node_Impl*> chunks_;
+    size_t chunk_used_;
+    // slots given back by collect(), reused before carving out new ones
+    vector<Node_Impl*> free_slots_;
+    // everything allocated while a scope is open, innermost scope last
+    vector<Node_Impl*> scope_log_;
+    size_t scope_depth_;
+    size_t next_collection_;
+    // canonical constants, made on first use
+    static const size_t small_number_limit = 256;
+    Node true_, false_, nil_;
+    vector<Node> small_numbers_;
+    Node canonical(Node& slot, Node n);
+    Node_Impl* next_slot();
+    Node_Impl* alloc_Node_Impl(Node::Type type, size_t file, size_t offset);
     // returns a deep-copy of its argument
     Node_Impl* alloc_Node_Impl(Node_Impl* ip);
   public:
+    Node_Factory();
     // for cloning nodes
     Node operator()(const Node& n1);
+    // for copy-on-write: copies the node itself but shares its children
+    Node shallow_copy(const Node& n1);
     // for making leaf nodes out of terminals/tokens
-    Node operator()(Node::Type type, string file, size_t line, Token t);
+    Node operator()(Node::Type type, size_t file, size_t offset, Token t);
+    // for making literals, which keep their text along with its value
+    Node operator()(Node::Type type, size_t file, size_t offset, Token t, double v);
     // for making boolean values or interior nodes that have children
-    Node operator()(Node::Type type, string file, size_t line, size_t size);
+    Node operator()(Node::Type type, size_t file, size_t offset, size_t size);
     // // for making nodes representing boolean values
-    // Node operator()(Node::Type type, string file, size_t line, bool b);
+    // Node operator()(Node::Type type, size_t file, size_t offset, bool b);
     // for making nodes representing numbers
-    Node operator()(string file, size_t line, double v, Node::Type type = Node::number);
+    Node operator()(size_t file, size_t offset, double v, Node::Type type = Node::number);
     // for making nodes representing numeric dimensions (e.g. 5px, 3em)
-    Node operator()(string file, size_t line, double v, const Token& t);
+    Node operator()(size_t file, size_t offset, double v, const Token& t);
     // for making nodes representing rgba color quads
-    Node operator()(string file, size_t line, double r, double g, double b, double a = 1.0);
+    Node operator()(size_t file, size_t offset, double r, double g, double b, double a = 1.0);
+
+    // Canonical, immutable values shared by everything made by this factory.
+    // They carry no file or offset of their own.
+    Node boolean(bool b);
+    Node nil();
+    // canonical for small non-negative integers, a fresh node otherwise
+    Node number(size_t file, size_t offset, double v);
 
+    // Reclaiming temporaries: collect(scope, roots) frees every node that
+    // was allocated since open_scope() returned `scope` and that can't be
+    // reached from the roots. Anything else still referring to such nodes
+    // has to be passed in as a root.
+    static const size_t collect_threshold = 16 * chunk_size;
+    size_t open_scope();
+    void close_scope();
+    bool should_collect(size_t scope) const;
+    void collect(size_t scope, const vector<Node>& roots);
+
+    size_t size() const;
     void free();
   };
-  
-}
\ No newline at end of file
+
+}
@@ -26,6 +26,24 @@ namespace Sass {
       return pred(*src) ? src + 1 : 0;
     }
 
+    // The classes each character belongs to, as bits of a table indexed by
+    // the (unsigned) byte, so that classifying a character is one lookup
+    // whatever the C locale is.
+    enum Char_Class {
+      space_class  = 1 << 0,
+      alpha_class  = 1 << 1,
+      digit_class  = 1 << 2,
+      xdigit_class = 1 << 3,
+      punct_class  = 1 << 4
+    };
+    extern const unsigned char char_classes[256];
+
+    // Match a single character that is in any of the supplied classes.
+    template <unsigned char classes>
+    const char* class_char(const char* src) {
+      return (char_classes[static_cast<unsigned char>(*src)] & classes) ? src + 1 : 0;
+    }
+
     // Match a single character that is a member of the supplied class.
     template <const char* char_class>
     const char* class_char(const char* src) {
@@ -50,12 +68,20 @@ namespace Sass {
       return p == src ? 0 : p;
     }
     
+    // Declares the text [begin, end) that's about to be scanned, so that
+    // skip_spaces and find_char can read it a block at a time. Elsewhere they
+    // still work, a byte at a time. Per thread.
+    void scan_text(const char* begin, const char* end);
+    // The first byte at or after src that isn't whitespace.
+    const char* skip_spaces(const char* src);
+    // The first byte at or after src that's c, or else the terminating NUL.
+    const char* find_char(const char* src, char c);
+
     // Match a sequence of characters up to the next newline.
     template <const char* prefix>
     const char* to_endl(const char* src) {
       if (!(src = exactly<prefix>(src))) return 0;
-      while (*src && *src != '\n') ++src;
-      return src;
+      return find_char(src, '\n');
     }
     
     // Match a sequence of characters delimited by the supplied chars.
@@ -63,12 +89,11 @@ namespace Sass {
     const char* delimited_by(const char* src) {
       src = exactly<beg>(src);
       if (!src) return 0;
-      const char* stop;
       while (1) {
+        src = find_char(src, end);
         if (!*src) return 0;
-        stop = exactly<end>(src);
-        if (stop && (!esc || *(src - 1) != '\\')) return stop;
-        src = stop ? stop : src + 1;
+        if (!esc || *(src - 1) != '\\') return src + 1;
+        ++src;
       }
     }
     
@@ -79,6 +104,7 @@ namespace Sass {
       if (!src) return 0;
       const char* stop;
       while (1) {
+        src = find_char(src, *end);
         if (!*src) return 0;
         stop = exactly<end>(src);
         if (stop && (!esc || *(src - 1) != '\\')) return stop;
@@ -267,12 +293,12 @@ namespace Sass {
     }
     
     // Match a single character satisfying the ctype predicates.
-    const char* space(const char* src);
-    const char* alpha(const char* src);
-    const char* digit(const char* src);
-    const char* xdigit(const char* src);
-    const char* alnum(const char* src);
-    const char* punct(const char* src);
+    inline const char* space(const char* src)  { return class_char<space_class>(src); }
+    inline const char* alpha(const char* src)  { return class_char<alpha_class>(src); }
+    inline const char* digit(const char* src)  { return class_char<digit_class>(src); }
+    inline const char* xdigit(const char* src) { return class_char<xdigit_class>(src); }
+    inline const char* alnum(const char* src)  { return class_char<alpha_class | digit_class>(src); }
+    inline const char* punct(const char* src)  { return class_char<punct_class>(src); }
     // Match multiple ctype characters.
     const char* spaces(const char* src);
     const char* alphas(const char* src);
@@ -37,12 +37,28 @@ extern "C" {
   sass_folder_context* sass_new_folder_context()
     { return (sass_folder_context*) calloc(1, sizeof(sass_folder_context)); }
 
+  static size_t max_depth(const sass_options& options)
+  { return options.max_depth > 0 ? options.max_depth : Sass::Context::default_max_depth; }
+
+  static void report_stats(const Sass::Context& cpp_ctx, sass_stats& stats)
+  {
+    stats.memo_hits        = cpp_ctx.memo_hits;
+    stats.memo_misses      = cpp_ctx.memo_misses;
+    stats.expansion_hits   = cpp_ctx.expansion_hits;
+    stats.expansion_misses = cpp_ctx.expansion_misses;
+    stats.pruned           = cpp_ctx.pruned.size();
+  }
+
   static char* process_document(Sass::Document& doc, int style)
   {
     using namespace Sass;
     doc.parse_scss();
+    resolve(doc.root, doc.context);
+    prune(doc.root, doc.context);
+    fold(doc.root, doc.context);
+    compile(doc.root, doc.context);
     eval(doc.root,
-         doc.context.new_Node(Node::none, doc.path, doc.line, 0),
+         doc.context.new_Node(Node::none, doc.file, doc.offset(), 0),
          doc.context.global_env,
          doc.context.function_env,
          doc.context.new_Node,
@@ -57,8 +73,8 @@ extern "C" {
   int sass_compile(sass_context* c_ctx)
   {
     using namespace Sass;
+    Context cpp_ctx(c_ctx->options.include_paths, max_depth(c_ctx->options));
     try {
-      Context cpp_ctx(c_ctx->options.include_paths);
       // Document doc(0, c_ctx->input_string, cpp_ctx);
       Document doc(Document::make_from_source_chars(cpp_ctx, c_ctx->source_string));
       c_ctx->output_string = process_document(doc, c_ctx->options.output_style);
@@ -67,7 +83,7 @@ extern "C" {
     }
     catch (Error& e) {
       stringstream msg_stream;
-      msg_stream << "ERROR -- " << e.path << ", line " << e.line << ": " << e.message << endl;
+      msg_stream << "ERROR -- " << cpp_ctx.file_paths[e.file] << ", line " << cpp_ctx.line_of(e.file, e.offset) << ": " << e.message << endl;
       string msg(msg_stream.str());
       char* msg_str = (char*) malloc(msg.size() + 1);
       strcpy(msg_str, msg.c_str());
@@ -86,14 +102,15 @@ extern "C" {
       c_ctx->error_message = msg_str;
     }
     // TO DO: CATCH EVERYTHING ELSE
+    report_stats(cpp_ctx, c_ctx->stats);
     return 0;
   }
   
   int sass_compile_file(sass_file_context* c_ctx)
   {
     using namespace Sass;
+    Context cpp_ctx(c_ctx->options.include_paths, max_depth(c_ctx->options));
     try {
-      Context cpp_ctx(c_ctx->options.include_paths);
       // Document doc(c_ctx->input_path, 0, cpp_ctx);
       Document doc(Document::make_from_file(cpp_ctx, string(c_ctx->input_path)));
       // cerr << "MADE A DOC AND CONTEXT OBJ" << endl;
@@ -104,7 +121,7 @@ extern "C" {
     }
     catch (Error& e) {
       stringstream msg_stream;
-      msg_stream << "ERROR -- " << e.path << ", line " << e.line << ": " << e.message << endl;
+      msg_stream << "ERROR -- " << cpp_ctx.file_paths[e.file] << ", line " << cpp_ctx.line_of(e.file, e.offset) << ": " << e.message << endl;
       string msg(msg_stream.str());
       char* msg_str = (char*) malloc(msg.size() + 1);
       strcpy(msg_str, msg.c_str());
@@ -123,6 +140,7 @@ extern "C" {
       c_ctx->error_message = msg_str;
     }
     // TO DO: CATCH EVERYTHING ELSE
+    report_stats(cpp_ctx, c_ctx->stats);
     return 0;
   }
   
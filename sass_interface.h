@@ -10,6 +10,18 @@ extern "C" {
 struct sass_options {
   int output_style;
   char* include_paths;
+  int max_depth; // levels of nesting and calls allowed; 0 for the default
+};
+
+// how often memoized calls and mixin expansions were reused, and how many
+// unused top-level definitions and assignments were dropped, filled in by
+// sass_compile and sass_compile_file
+struct sass_stats {
+  int memo_hits;
+  int memo_misses;
+  int expansion_hits;
+  int expansion_misses;
+  int pruned;
 };
 
 struct sass_context {
@@ -18,6 +30,7 @@ struct sass_context {
   struct sass_options options;
   int error_status;
   char* error_message;
+  struct sass_stats stats;
 };
 
 struct sass_file_context {
@@ -26,6 +39,7 @@ struct sass_file_context {
   struct sass_options options;
   int error_status;
   char* error_message;
+  struct sass_stats stats;
 };
 
 struct sass_folder_context {
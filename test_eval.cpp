@@ -0,0 +1,177 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+#include "sass_interface.h"
+
+// Stylesheets whose evaluation has gone wrong before, compiled through the
+// C interface, with the output or error they should produce.
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(const char* name, const char* src, const char* expected, bool should_fail = false, int max_depth = 0)
+{
+  sass_context* ctx = sass_new_context();
+  ctx->source_string = const_cast<char*>(src);
+  ctx->options.output_style = SASS_STYLE_NESTED;
+  ctx->options.include_paths = const_cast<char*>("");
+  ctx->options.max_depth = max_depth;
+  sass_compile(ctx);
+  string got(ctx->error_status ? ctx->error_message : ctx->output_string);
+  bool ok = should_fail ? (ctx->error_status && got.find(expected) != string::npos)
+                        : (!ctx->error_status && got == expected);
+  if (!ok) {
+    cerr << name << ": expected " << (should_fail ? "an error containing" : "")
+         << endl << expected << endl << "got" << endl << got << endl;
+    ++failures;
+  }
+  ctx->source_string = 0;
+  sass_free_context(ctx);
+}
+
+static sass_stats stats_of(const char* src)
+{
+  sass_context* ctx = sass_new_context();
+  ctx->source_string = const_cast<char*>(src);
+  ctx->options.output_style = SASS_STYLE_NESTED;
+  ctx->options.include_paths = const_cast<char*>("");
+  sass_compile(ctx);
+  sass_stats stats = ctx->stats;
+  ctx->source_string = 0;
+  sass_free_context(ctx);
+  return stats;
+}
+
+static void check_memo(const char* name, const char* src, int hits, int misses)
+{
+  sass_stats stats = stats_of(src);
+  if (stats.memo_hits != hits || stats.memo_misses != misses) {
+    cerr << name << ": expected " << hits << " memo hits and " << misses << " misses, got "
+         << stats.memo_hits << " and " << stats.memo_misses << endl;
+    ++failures;
+  }
+}
+
+static void check_pruned(const char* name, const char* src, int pruned)
+{
+  sass_stats stats = stats_of(src);
+  if (stats.pruned != pruned) {
+    cerr << name << ": expected " << pruned << " pruned, got " << stats.pruned << endl;
+    ++failures;
+  }
+}
+
+// Runaway recursion fails with an error instead of overflowing the stack,
+// even on threads with much smaller stacks than the main one.
+
+static const char* runaway_function =
+  "@function f($n) { @if $n <= 0 { @return 0; } @return 1 + f($n - 1); }\n"
+  ".a { b: f(100000); }\n";
+
+static const char* runaway_mixin =
+  "@mixin m($n) { .x { a: $n; @include m($n + 1); } }\n"
+  ".a { @include m(0); }\n";
+
+static const char* nested_list =
+  "$l: 0;\n"
+  "@for $i from 1 through 100000 { $l: ($l, 1); }\n"
+  ".a { b: $l; }\n";
+
+struct Small_Stack_Case {
+  const char* name;
+  const char* src;
+  const char* expected;
+  int max_depth;
+};
+
+static void* run_small_stack_case(void* arg)
+{
+  Small_Stack_Case* c = static_cast<Small_Stack_Case*>(arg);
+  check(c->name, c->src, c->expected, true, c->max_depth);
+  return 0;
+}
+
+// AddressSanitizer makes every frame several times bigger
+#ifdef __SANITIZE_ADDRESS__
+static const size_t stack_scale = 8;
+#else
+static const size_t stack_scale = 1;
+#endif
+
+static void check_on_small_stack(size_t stack_size, Small_Stack_Case c)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, stack_size * stack_scale);
+  if (pthread_create(&thread, &attr, run_small_stack_case, &c)) {
+    cerr << c.name << ": couldn't start a thread" << endl;
+    ++failures;
+  }
+  else pthread_join(thread, 0);
+  pthread_attr_destroy(&attr);
+}
+
+int main()
+{
+  // operands evaluated by the register machine aren't evaluated again when
+  // an operation has to be done the slow way
+  check("side effects in compiled expressions",
+        "$count: 0;\n"
+        "@function bump() { $count: $count + 1; @return red; }\n"
+        ".a { x: bump() + 1; y: $count; z: -bump(); w: $count; v: bump() == red; u: $count; }\n",
+        ".a {\n  x: red1;\n  y: 1;\n  z: -red;\n  w: 2;\n  v: true;\n  u: 3; }\n");
+
+  // units are case-insensitive, and only sums and differences convert them
+  check("unit conversions",
+        ".a { a: 1Px + 1px; b: 2cm * 3mm; c: 10mm + 4Q; d: 1kHz + 1Hz; e: 1khz == 1000HZ; f: (2cm / 1mm); }\n",
+        ".a {\n  a: 2Px;\n  b: 6cm;\n  c: 11mm;\n  d: 1.001kHz;\n  e: true;\n  f: 2; }\n");
+  check("incompatible units", ".a { b: 1px + 1s; }\n", "incompatible units px and s", true);
+
+  // assignments put off until they're read still report unbound variables
+  // read by the functions they call
+  check("unbound variable in a deferred call",
+        "$a: 1px; @function f() { @return $zz; } $b: f(); .x { y: $a; }\n",
+        "unbound variable $zz", true);
+
+  // pruning unused assignments keeps those that would report an error
+  check("unused assignment of an unbound variable",
+        "$bad: $undefined;\n.a { b: c; }\n",
+        "unbound variable $undefined", true);
+  check_pruned("unused definitions and assignments",
+               "$used: 1px; $unused: 2px; $later: $used;\n"
+               "@mixin m { a: b; } @function f() { @return 1; }\n"
+               ".a { b: $used; }\n",
+               4);
+
+  Small_Stack_Case deep_cases[] = {
+    { "runaway function on 1MB", runaway_function, "nested too deeply", 0 },
+    { "runaway mixin on 1MB",    runaway_mixin,    "nested too deeply", 0 },
+    { "nested list on 1MB",      nested_list,      "nested too deeply", 0 },
+    { "runaway function on 256KB with max_depth 100", runaway_function, "more than 100 levels", 100 }
+  };
+  for (size_t i = 0; i < 3; ++i) check_on_small_stack(1 << 20, deep_cases[i]);
+  check_on_small_stack(1 << 18, deep_cases[3]);
+
+  check_memo("repeated calls to a pure function",
+             "@function sq($x) { @return $x * $x; }\n"
+             ".a { b: sq(2); c: sq(2); d: sq(3); }\n",
+             1, 2);
+  // a function with parameters doesn't make its callers impure
+  check_memo("pure functions calling pure functions",
+             "@function sq($x) { @return $x * $x; }\n"
+             "@function f($y) { @return sq($y) + 1; }\n"
+             ".a { b: f(2); c: f(2); d: f(2); }\n",
+             2, 2);
+
+  if (failures) {
+    cerr << failures << " failed" << endl;
+    return 1;
+  }
+  cout << "all passed" << endl;
+  return 0;
+}
@@ -17,19 +17,28 @@ int main()
   
   cout << sizeof(Node_Impl*) << endl;
   cout << sizeof(Node) << endl;
+  cout << sizeof(Node_List) << endl;
   cout << sizeof(Node_Impl) << endl << endl;
+
+  // Keep an eye on the layout: every node in a document pays for this.
+  const size_t max_Node_Impl_size = 80;
+  if (sizeof(Node_Impl) > max_Node_Impl_size) {
+    cerr << "sizeof(Node_Impl) is " << sizeof(Node_Impl)
+         << ", expected at most " << max_Node_Impl_size << endl;
+    return 1;
+  }
   
   Node_Factory new_Node = Node_Factory();
   
-  Node interior(new_Node(Node::block, "", 0, 3));
+  Node interior(new_Node(Node::block, 0, 0, 3));
   
   cout << interior.size() << endl;
   cout << interior.has_children() << endl;
   cout << interior.should_eval() << endl << endl;
   
-  Node num(new_Node("", 0, 255, 123, 32));
-  Node num2(new_Node("", 0, 255, 123, 32));
-  Node num3(new_Node("", 0, 255, 122, 20, .75));
+  Node num(new_Node(0, 0, 255, 123, 32));
+  Node num2(new_Node(0, 0, 255, 123, 32));
+  Node num3(new_Node(0, 0, 255, 122, 20, .75));
   
   cout << num.size() << endl;
   cout << num.has_children() << endl;
@@ -50,11 +59,11 @@ int main()
   Node num4(new_Node(num3));
   cout << num3[3].numeric_value() << endl;
   cout << num4[3].numeric_value() << endl;
-  num4[3] = new_Node("", 0, 0.4567);
+  num4[3] = new_Node(0, 0, 0.4567);
   cout << num3[3].numeric_value() << endl;
   cout << num4[3].numeric_value() << endl << endl;
 
-  Node block1(new_Node(Node::block, "block", 1, 2));
+  Node block1(new_Node(Node::block, 0, 1, 2));
   block1 << num2 << num4;
 
   Node block2(new_Node(block1));
@@ -62,14 +71,14 @@ int main()
   cout << (block1 == block2) << endl;
   cout << block1[1][3].numeric_value() << endl;
   cout << block2[1][3].numeric_value() << endl;
-  block2[1][3] = new_Node("", 0, .9876);
+  block2[1][3] = new_Node(0, 0, .9876);
   cout << block1[1][3].numeric_value() << endl;
   cout << block2[1][3].numeric_value() << endl << endl;
 
   map<Node, string> dict;
 
-  Node n(new_Node("", 0, 42));
-  Node m(new_Node("", 0, 41));
+  Node n(new_Node(0, 0, 42));
+  Node m(new_Node(0, 0, 41));
 
   dict[n] = "hello";
   dict[m] = "goodbye";
@@ -90,6 +99,11 @@ int main()
 
 
 
+  cout << "Canonical constants: " << endl;
+  cout << new_Node.boolean(true).is(new_Node.boolean(true)) << endl;
+  cout << new_Node.number(0, 0, 255).is(new_Node.number(0, 0, 255)) << endl;
+  cout << new_Node.number(0, 0, 2.5).is(new_Node.number(0, 0, 2.5)) << endl << endl;
+
   new_Node.free();
   return 0;
 }
\ No newline at end of file